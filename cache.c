@@ -0,0 +1,566 @@
+#define _GNU_SOURCE
+#include "cache.h"
+#include "epoch.h"
+#include "slab.h"
+
+/*
+ * cache.c - 프록시의 웹 객체 캐시
+ *
+ * 캐시는 경로 해시의 상위 비트로 고른 여러 스트라이프(cache_shard_t)로 나뉘고, 스트라이프마다
+ * 뮤텍스, 교체 정책(policy.c)의 상태, 경로로 객체를 찾는 해시 인덱스를 가집니다.
+ * 인덱스는 선형 탐사 개방 주소법 테이블로, 객체에 저장해 둔 64비트 해시를 먼저 비교하고
+ * 같을 때만 경로 문자열을 비교합니다.
+ *
+ * 적중은 락을 잡지 않습니다. 에포크 구간 안에서 인덱스를 탐사하고 찾은 객체의 참조 수를
+ * 올려 고정한 뒤, 구간 밖에서 response_ptr을 전송합니다. 캐시에서 빠진 객체는 마지막 참조가
+ * 풀릴 때 epoch_retire로 넘겨져, 그 객체를 볼 수 있던 스레드가 모두 빠져나간 뒤 해제됩니다.
+ *
+ * 객체와 본문은 슬랩 할당기에서 받으며, 크기 제한은 콘텐츠 길이가 아니라 본문이 실제로
+ * 차지하는 슬랩 청크의 크기에 대해 적용합니다.
+ *
+ * memfd 저장을 켜면 CACHE_MEMFD_MIN 이상의 본문은 객체마다 봉인된 memfd로 옮기고, send_cache는
+ * 헤더를 보낸 뒤 본문을 sendfile로 사용자 공간 복사 없이 보냅니다. 객체마다 파일을 따로 두므로
+ * 해제된 본문의 페이지가 아직 소켓 송신 큐에 있는 동안 다른 객체로 덮어써지는 일이 없습니다.
+ *
+ * 모든 검색은 스트라이프의 TinyLFU 추정기에 접근을 기록합니다. 새 객체를 넣으려면 다른 객체를
+ * 내보내야 할 때, 새 객체가 내보낼 객체들보다 자주 요청된 경우에만 받아들여서 한 번만 요청되는
+ * URL들이 자주 쓰이는 객체들을 밀어내지 못하게 합니다.
+ *
+ * 교체 정책은 적중을 락 없이 기록하고(LRU는 승격 버퍼, 나머지는 객체의 비트나 빈도),
+ * 삽입과 내보내기는 스트라이프 락 아래에서 정책의 함수로 처리합니다.
+ */
+
+#define CACHE_TOMB ((web_object_t *)1) // 제거된 객체 자리 (탐사는 계속 진행)
+
+// 객체 하나가 크기 제한에 매겨질 수 있는 최대 크기 (클래스 간격 1.25배 + 최대 키와 응답 헤더 길이)
+#define CACHE_MAX_CHARGE (MAX_OBJECT_SIZE + MAX_OBJECT_SIZE / 4 + 2 * MAXLINE)
+
+// 전역 변수 초기화
+cache_t proxy_cache;
+
+/**
+ * cache_index_new 함수: nslots개의 빈 슬롯을 가진 해시 인덱스를 만듭니다.
+ */
+static cache_index_t *cache_index_new(size_t nslots)
+{
+  cache_index_t *index = Calloc(1, sizeof(cache_index_t) + nslots * sizeof(web_object_t *));
+  index->nslots = nslots;
+  return index;
+}
+
+/**
+ * cache_init 함수: 빈 캐시를 초기화합니다.
+ * 스트라이프 하나가 가장 큰 객체를 담을 수 있도록 스트라이프 수를 정합니다.
+ * cache: 초기화할 캐시
+ * max_cache_size: 캐시의 최대 크기
+ * policy: 교체 정책 (NULL이면 LRU)
+ */
+void cache_init(cache_t *cache, size_t max_cache_size, const cache_policy_t *policy)
+{
+  int i;
+
+  cache->nshards = max_cache_size / CACHE_MAX_CHARGE;
+  if (cache->nshards > CACHE_NSHARDS)
+    cache->nshards = CACHE_NSHARDS;
+  if (cache->nshards < 1)
+    cache->nshards = 1;
+  cache->max_cache_size = max_cache_size;
+  cache->admission = 1;
+  cache->memfd = 0;
+  cache->policy = policy ? policy : &lru_policy;
+  if (posix_memalign((void **)&cache->shards, 64, cache->nshards * sizeof(cache_shard_t)) != 0)
+    unix_error("posix_memalign error");
+
+  for (i = 0; i < cache->nshards; i++)
+  {
+    cache_shard_t *shard = &cache->shards[i];
+    pthread_mutex_init(&shard->lock, NULL);
+    shard->rootp = NULL;
+    shard->lastp = NULL;
+    shard->index = cache_index_new(CACHE_INIT_SLOTS);
+    shard->nobjects = 0;
+    shard->ntombs = 0;
+    shard->total_cache_size = 0;
+    shard->max_cache_size = max_cache_size / cache->nshards;
+    tinylfu_init(&shard->lfu, shard->max_cache_size / 1024);
+    shard->policy_state = NULL;
+    if (cache->policy->init)
+      cache->policy->init(shard);
+  }
+}
+
+/**
+ * cache_hash 함수: 캐시 키의 64비트 해시(FNV-1a)를 계산합니다.
+ * 짧은 키의 FNV-1a는 상위 비트가 잘 섞이지 않아 스트라이프가 고르게 나뉘지 않으므로
+ * 마지막에 murmur3의 fmix64로 모든 비트를 섞습니다.
+ * key: 해시할 문자열
+ * 반환: 해시 값
+ */
+uint64_t cache_hash(const char *key)
+{
+  uint64_t h = 14695981039346656037ULL;
+
+  while (*key)
+  {
+    h ^= (unsigned char)*key++;
+    h *= 1099511628211ULL;
+  }
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+}
+
+/**
+ * cache_object_alloc 함수: 슬랩에서 키와 응답 헤더를 포함한 크기만큼 본문 없는 캐시 객체를 할당합니다.
+ */
+static web_object_t *cache_object_alloc(char *path, char *hdr, size_t hdr_len)
+{
+  size_t path_len = strlen(path);
+  web_object_t *web_object = slab_alloc(sizeof(web_object_t) + path_len + 1 + hdr_len + 1);
+
+  memset(web_object, 0, sizeof(web_object_t));
+  memcpy(web_object->path, path, path_len + 1);
+  web_object->path_len = path_len;
+  memcpy(cache_header(web_object), hdr, hdr_len);
+  cache_header(web_object)[hdr_len] = '\0';
+  web_object->hdr_len = hdr_len;
+  return web_object;
+}
+
+/**
+ * new_cache_object 함수: 슬랩에서 키와 응답 헤더를 포함한 크기만큼 캐시 객체를 할당해 초기화합니다.
+ * 헤더는 적중할 때마다 다시 만들지 않도록 한 번만 복사해 둡니다.
+ * path: 객체의 URI 경로
+ * hdr, hdr_len: 홉별 필드를 뺀 응답의 상태 줄과 헤더 ("\r\n\r\n"까지, MAXLINE 이하, http_end_to_end)
+ * body: slab_alloc으로 할당한 본문 (소유권이 객체로 넘어감)
+ * content_length: 본문의 길이
+ * 반환: write_cache에 넘길 객체 (만료 시각은 호출자가 정함)
+ */
+web_object_t *new_cache_object(char *path, char *hdr, size_t hdr_len, char *body, int content_length)
+{
+  web_object_t *web_object = cache_object_alloc(path, hdr, hdr_len);
+
+  web_object->response_ptr = body;
+  web_object->content_length = content_length;
+  web_object->alloc_size = slab_chunk_size(web_object) + slab_chunk_size(body);
+  return web_object;
+}
+
+/**
+ * clone_cache_object 함수: 본문은 같고 응답 헤더만 다른 새 객체를 만듭니다 (304로 재검증한 뒤 사용).
+ * memfd 본문은 복사하지 않고 파일 디스크립터만 복제합니다.
+ * web_object: 원래 객체 (참조를 가진 상태)
+ * hdr, hdr_len: 새 응답 헤더
+ * 반환: write_cache 또는 free_cache_object에 넘길 객체, memfd의 본문을 읽지 못하면 NULL
+ */
+web_object_t *clone_cache_object(web_object_t *web_object, char *hdr, size_t hdr_len)
+{
+  web_object_t *clone;
+  char *body;
+  ssize_t n;
+  int fd, pos;
+
+  if (web_object->memfd && (fd = dup(web_object->body_fd)) >= 0)
+  {
+    clone = cache_object_alloc(web_object->path, hdr, hdr_len);
+    clone->body_fd = fd;
+    clone->memfd = 1;
+    clone->content_length = web_object->content_length;
+    clone->alloc_size = slab_chunk_size(clone) + (web_object->alloc_size - slab_chunk_size(web_object));
+    return clone;
+  }
+
+  body = slab_alloc(web_object->content_length);
+  if (web_object->memfd)
+  {
+    for (pos = 0; pos < web_object->content_length; pos += n)
+      if ((n = pread(web_object->body_fd, body + pos, web_object->content_length - pos, pos)) <= 0)
+      {
+        slab_free(body);
+        return NULL;
+      }
+  }
+  else
+    memcpy(body, web_object->response_ptr, web_object->content_length);
+  return new_cache_object(web_object->path, hdr, hdr_len, body, web_object->content_length);
+}
+
+/**
+ * cache_match 함수: 객체의 키가 주어진 키와 같은지 확인합니다.
+ * 해시와 길이가 같을 때만 바이트를 비교합니다.
+ */
+static inline int cache_match(web_object_t *obj, uint64_t hash, char *path, size_t path_len)
+{
+  return obj->hash == hash && obj->path_len == path_len && !memcmp(obj->path, path, path_len);
+}
+
+/**
+ * cache_shard 함수: 해시 값이 속한 스트라이프를 고릅니다.
+ * 인덱스가 하위 비트를 쓰므로 상위 비트로 고릅니다.
+ */
+static cache_shard_t *cache_shard(cache_t *cache, uint64_t hash)
+{
+  return &cache->shards[(hash >> 32) % cache->nshards];
+}
+
+/**
+ * cache_probe 함수: 해시 인덱스에서 경로가 일치하는 객체의 슬롯을 찾습니다 (스트라이프 락 필요).
+ * 해시 값이 같을 때만 문자열을 비교하며, 묘비는 건너뜁니다.
+ * 반환: 일치하는 객체의 슬롯, 없으면 탐사가 멈춘 빈 슬롯의 번호
+ */
+static size_t cache_probe(cache_index_t *index, uint64_t hash, char *path, size_t path_len)
+{
+  size_t mask = index->nslots - 1, i = hash & mask;
+  web_object_t *obj;
+
+  while ((obj = index->slots[i]) &&
+         (obj == CACHE_TOMB || !cache_match(obj, hash, path, path_len)))
+    i = (i + 1) & mask;
+  return i;
+}
+
+/**
+ * cache_find 함수: 락 없이 해시 인덱스에서 경로가 일치하는 객체를 찾습니다.
+ * 탐사 도중 슬롯이 묘비로 바뀔 수 있으므로 비교한 객체를 그대로 돌려줍니다.
+ * 반환: 찾은 객체의 포인터, 없으면 NULL 반환
+ */
+static web_object_t *cache_find(cache_index_t *index, uint64_t hash, char *path, size_t path_len)
+{
+  size_t mask = index->nslots - 1, i = hash & mask;
+  web_object_t *obj;
+
+  for (; (obj = __atomic_load_n(&index->slots[i], __ATOMIC_ACQUIRE)); i = (i + 1) & mask)
+    if (obj != CACHE_TOMB && cache_match(obj, hash, path, path_len))
+      return obj;
+  return NULL;
+}
+
+/**
+ * cache_rebuild 함수: 묘비 없이 새 해시 인덱스를 만들어 바꿉니다.
+ * 부하율이 1/4 이하가 되도록 크기를 정하고, 옛 인덱스는 에포크가 지난 뒤 해제합니다.
+ */
+static void cache_rebuild(cache_shard_t *shard)
+{
+  cache_index_t *old = shard->index, *index;
+  size_t i, j, nslots = CACHE_INIT_SLOTS, mask;
+
+  while (nslots < (shard->nobjects + 1) * 4)
+    nslots *= 2;
+  index = cache_index_new(nslots);
+  mask = nslots - 1;
+  for (i = 0; i < old->nslots; i++)
+  {
+    if (!old->slots[i] || old->slots[i] == CACHE_TOMB)
+      continue;
+    for (j = old->slots[i]->hash & mask; index->slots[j]; j = (j + 1) & mask)
+      ;
+    index->slots[j] = old->slots[i];
+  }
+  shard->ntombs = 0;
+  __atomic_store_n(&shard->index, index, __ATOMIC_RELEASE);
+  epoch_retire(old, free);
+}
+
+/**
+ * cache_unindex 함수: 객체를 해시 인덱스에서 빼고 그 자리에 묘비를 둡니다.
+ * 락 없이 탐사 중인 스레드가 뒤쪽 객체를 놓치지 않도록 객체들을 옮기지 않습니다.
+ */
+static void cache_unindex(cache_shard_t *shard, web_object_t *web_object)
+{
+  cache_index_t *index = shard->index;
+  size_t mask = index->nslots - 1, i = web_object->hash & mask;
+
+  while (index->slots[i] != web_object)
+    i = (i + 1) & mask;
+  __atomic_store_n(&index->slots[i], CACHE_TOMB, __ATOMIC_RELEASE);
+  shard->nobjects--;
+  shard->ntombs++;
+}
+
+/**
+ * cache_free 함수: 객체의 메모리를 해제합니다 (epoch_retire의 해제 함수).
+ */
+static void cache_free(void *vobj)
+{
+  web_object_t *web_object = vobj;
+
+  if (web_object->memfd)
+    close(web_object->body_fd);
+  else
+    slab_free(web_object->response_ptr);
+  slab_free(web_object);
+}
+
+/**
+ * free_cache_object 함수: 캐시에 넣지 않기로 한 객체를 해제합니다.
+ */
+void free_cache_object(web_object_t *web_object)
+{
+  cache_free(web_object);
+}
+
+/**
+ * cache_to_memfd 함수: 객체의 본문을 새 memfd로 옮기고 쓰기와 크기 변경을 봉인합니다.
+ * 실패하면 본문을 슬랩에 그대로 둡니다. 크기 제한에는 본문이 차지하는 페이지 크기를 매깁니다.
+ */
+static void cache_to_memfd(web_object_t *web_object)
+{
+  size_t page = sysconf(_SC_PAGESIZE);
+  int fd = memfd_create("cache", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+
+  if (fd < 0)
+    return;
+  if (rio_writen(fd, web_object->response_ptr, web_object->content_length) != web_object->content_length)
+  {
+    close(fd);
+    return;
+  }
+  fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL);
+
+  web_object->alloc_size -= slab_chunk_size(web_object->response_ptr);
+  web_object->alloc_size += (web_object->content_length + page - 1) / page * page;
+  slab_free(web_object->response_ptr);
+  web_object->body_fd = fd;
+  web_object->memfd = 1;
+}
+
+/**
+ * cache_remove 함수: 객체를 캐시에서 떼어내고 캐시의 참조를 놓습니다.
+ * 전송 중인 스레드가 있으면 마지막 참조가 풀릴 때 해제됩니다.
+ */
+static void cache_remove(const cache_policy_t *policy, cache_shard_t *shard, web_object_t *web_object)
+{
+  cache_unindex(shard, web_object);
+  policy->remove(shard, web_object);
+  shard->total_cache_size -= web_object->alloc_size;
+  web_object->cached = 0;
+  release_cache(web_object);
+}
+
+/**
+ * cache_deinit 함수: 캐시의 모든 객체와 메모리를 해제합니다.
+ * 다른 스레드가 캐시를 쓰거나 객체의 참조를 가지고 있지 않을 때만 호출해야 합니다.
+ * cache: 해제할 캐시
+ */
+void cache_deinit(cache_t *cache)
+{
+  cache_shard_t *shard;
+  web_object_t *obj;
+  size_t j;
+  int i;
+
+  for (i = 0; i < cache->nshards; i++)
+  {
+    shard = &cache->shards[i];
+    if (cache->policy->fini)
+      cache->policy->fini(shard); // LRU는 승격 버퍼의 참조를 여기서 놓음
+    for (j = 0; j < shard->index->nslots; j++)
+      if ((obj = shard->index->slots[j]) && obj != CACHE_TOMB)
+        cache_free(obj);
+    free(shard->index);
+    tinylfu_deinit(&shard->lfu);
+    pthread_mutex_destroy(&shard->lock);
+  }
+  free(cache->shards);
+}
+
+/**
+ * lookup_cache 함수: 주어진 경로의 캐시된 객체를 락 없이 찾아 참조를 하나 얻습니다.
+ * 반환된 객체는 release_cache를 부를 때까지 다른 스레드가 제거해도 해제되지 않습니다.
+ * cache: 검색할 캐시
+ * path: 찾을 객체의 경로
+ * 반환: 찾은 객체의 포인터, 없으면 NULL 반환
+ */
+web_object_t *lookup_cache(cache_t *cache, char *path)
+{
+  uint64_t hash = cache_hash(path);
+  cache_shard_t *shard = cache_shard(cache, hash);
+  cache_index_t *index;
+  web_object_t *web_object;
+  unsigned ref;
+
+  // 적중 여부와 관계없이 접근을 기록하고, 노화할 때가 되면 락이 비어 있을 때 노화
+  if (tinylfu_record(&shard->lfu, hash) && pthread_mutex_trylock(&shard->lock) == 0)
+  {
+    tinylfu_age(&shard->lfu);
+    pthread_mutex_unlock(&shard->lock);
+  }
+
+  epoch_enter();
+  index = __atomic_load_n(&shard->index, __ATOMIC_ACQUIRE);
+  web_object = cache_find(index, hash, path, strlen(path));
+  if (web_object)
+  {
+    // 참조 수가 0이면 이미 해제를 기다리는 객체이므로 놓친 것으로 처리
+    ref = __atomic_load_n(&web_object->refcnt, __ATOMIC_RELAXED);
+    do
+    {
+      if (ref == 0)
+      {
+        web_object = NULL;
+        break;
+      }
+    } while (!__atomic_compare_exchange_n(&web_object->refcnt, &ref, ref + 1, 1,
+                                          __ATOMIC_ACQUIRE, __ATOMIC_RELAXED));
+  }
+  epoch_exit();
+
+  if (web_object)
+    cache->policy->hit(shard, web_object);
+  return web_object;
+}
+
+/**
+ * release_cache 함수: lookup_cache로 얻은 참조를 놓습니다.
+ * 캐시에서 이미 빠진 객체의 마지막 참조였다면 에포크가 지난 뒤 해제되도록 넘깁니다.
+ * web_object: 참조를 놓을 객체
+ */
+void release_cache(web_object_t *web_object)
+{
+  if (__atomic_sub_fetch(&web_object->refcnt, 1, __ATOMIC_ACQ_REL) == 0)
+    epoch_retire(web_object, cache_free);
+}
+
+/**
+ * send_cache 함수: 캐시된 객체를 클라이언트에게 전송합니다.
+ * 저장해 둔 응답 헤더의 빈 줄 앞에 Connection 필드를 끼워 본문과 함께 writev 한 번으로 보냅니다.
+ * 본문이 memfd에 있으면 헤더를 MSG_MORE로 보내 본문과 같은 세그먼트에 담기게 하고,
+ * 본문은 sendfile로 보냅니다. 클라이언트가 연결을 끊어도 프로세스를 끝내지 않습니다.
+ * web_object: 전송할 캐시된 객체의 포인터 (참조를 가진 상태)
+ * clientfd: 클라이언트 소켓의 파일 디스크립터
+ * keepalive: 응답 뒤에도 연결을 유지하면 1
+ * 반환: 0, 보내지 못했으면 -1
+ */
+int send_cache(web_object_t *web_object, int clientfd, int keepalive)
+{
+  char *conn = keepalive ? CONN_KEEP_ALIVE "\r\n" : CONN_CLOSE "\r\n";
+  struct iovec iov[3];
+
+  iov[0].iov_base = cache_header(web_object);
+  iov[0].iov_len = web_object->hdr_len - 2;
+  iov[1].iov_base = conn;
+  iov[1].iov_len = strlen(conn);
+  if (web_object->memfd)
+  {
+    if (rio_sendmore(clientfd, iov[0].iov_base, iov[0].iov_len) < 0 ||
+        rio_sendmore(clientfd, conn, iov[1].iov_len) < 0 ||
+        rio_sendfile(clientfd, web_object->body_fd, 0, web_object->content_length) != web_object->content_length)
+      return -1;
+    return 0;
+  }
+
+  iov[2].iov_base = web_object->response_ptr;
+  iov[2].iov_len = web_object->content_length;
+  return rio_writev(clientfd, iov, 3) < 0 ? -1 : 0;
+}
+
+/**
+ * dup_cache_response 함수: 캐시된 객체의 응답(헤더 + Connection 필드 + 본문)을 새 버퍼에 복사합니다.
+ * 응답을 여러 번에 나누어 보내는 이벤트 루프 모드에서 사용합니다.
+ * web_object: 응답할 캐시된 객체의 포인터 (참조를 가진 상태)
+ * len: 응답의 길이를 저장할 위치
+ * keepalive: send_cache와 같음
+ * 반환: 호출자가 해제해야 하는 응답 버퍼, memfd의 본문을 읽지 못하면 NULL
+ */
+char *dup_cache_response(web_object_t *web_object, size_t *len, int keepalive)
+{
+  char *conn = keepalive ? CONN_KEEP_ALIVE "\r\n" : CONN_CLOSE "\r\n";
+  size_t hdr_len = web_object->hdr_len - 2 + strlen(conn);
+  char *out = Malloc(hdr_len + web_object->content_length);
+  ssize_t n;
+  int pos;
+
+  memcpy(out, cache_header(web_object), web_object->hdr_len - 2);
+  memcpy(out + web_object->hdr_len - 2, conn, strlen(conn));
+  if (web_object->memfd)
+  {
+    for (pos = 0; pos < web_object->content_length; pos += n)
+      if ((n = pread(web_object->body_fd, out + hdr_len + pos,
+                     web_object->content_length - pos, pos)) <= 0)
+      {
+        free(out);
+        return NULL;
+      }
+  }
+  else
+    memcpy(out + hdr_len, web_object->response_ptr, web_object->content_length);
+  *len = hdr_len + web_object->content_length;
+  return out;
+}
+
+/**
+ * write_cache 함수: 새로운 객체를 캐시에 추가합니다.
+ * 같은 경로의 객체가 이미 있으면 새 객체로 바꾸고, 스트라이프의 최대 크기를 넘으면
+ * 교체 정책이 고른 객체부터 제거합니다. 새 경로의 객체가 자리를 비워야 하면 먼저 내보낼
+ * 객체들을 미리 보며 (peek) TinyLFU로 새 객체의 추정 빈도가 그 모두보다 높은지 확인하고,
+ * 아니면 아무것도 내보내지 않고 새 객체를 거절합니다. 스트라이프의 최대 크기보다 큰 객체는
+ * 아무것도 내보내지 않고 바로 거절합니다 (작은 캐시를 여러 샤드가 나누어 가질 때).
+ * 객체의 소유권은 캐시로 넘어가며, 입장이 거절된 객체는 바로 해제됩니다.
+ * cache: 객체를 추가할 캐시
+ * web_object: 캐시에 추가할 객체의 포인터
+ */
+void write_cache(cache_t *cache, web_object_t *web_object)
+{
+  const cache_policy_t *policy = cache->policy;
+  cache_shard_t *shard;
+  cache_index_t *index;
+  web_object_t *victim;
+  size_t slot, freed;
+  int admit, freq;
+
+  if (cache->memfd && !web_object->memfd && web_object->content_length >= CACHE_MEMFD_MIN)
+    cache_to_memfd(web_object); // 락 밖에서 복사
+
+  web_object->hash = cache_hash(web_object->path);
+  web_object->refcnt = 1; // 캐시 자신의 참조
+  web_object->promote_pending = 0;
+  web_object->cached = 1;
+  shard = cache_shard(cache, web_object->hash);
+  if (web_object->alloc_size > shard->max_cache_size)
+  {
+    cache_free(web_object); // 스트라이프를 다 비워도 들어가지 않음
+    return;
+  }
+
+  pthread_mutex_lock(&shard->lock);
+  if (policy->flush)
+    policy->flush(shard);
+
+  // 같은 경로의 객체는 입장 허가 없이 새 것으로 바꿈
+  slot = cache_probe(shard->index, web_object->hash, web_object->path, web_object->path_len);
+  admit = shard->index->slots[slot] || !cache->admission;
+  if (shard->index->slots[slot])
+    cache_remove(policy, shard, shard->index->slots[slot]);
+  if (!admit)
+  {
+    freq = tinylfu_estimate(&shard->lfu, web_object->hash);
+    for (freed = 0, victim = policy->peek(shard, NULL);
+         victim && shard->total_cache_size - freed + web_object->alloc_size > shard->max_cache_size;
+         freed += victim->alloc_size, victim = policy->peek(shard, victim))
+      if (tinylfu_estimate(&shard->lfu, victim->hash) >= freq)
+      {
+        pthread_mutex_unlock(&shard->lock);
+        cache_free(web_object);
+        return;
+      }
+  }
+
+  while (shard->total_cache_size + web_object->alloc_size > shard->max_cache_size &&
+         (victim = policy->victim(shard)))
+    cache_remove(policy, shard, victim);
+
+  // 객체와 묘비가 슬롯의 절반을 넘으면 인덱스를 다시 만든 뒤 빈 슬롯에 넣음
+  if ((shard->nobjects + shard->ntombs + 1) * 2 > shard->index->nslots)
+    cache_rebuild(shard);
+  index = shard->index;
+  slot = cache_probe(index, web_object->hash, web_object->path, web_object->path_len);
+  __atomic_store_n(&index->slots[slot], web_object, __ATOMIC_RELEASE);
+  shard->nobjects++;
+  shard->total_cache_size += web_object->alloc_size;
+  policy->insert(shard, web_object);
+
+  pthread_mutex_unlock(&shard->lock);
+}
@@ -0,0 +1,175 @@
+#ifndef __CACHE_H__
+#define __CACHE_H__
+
+#include <stdint.h>
+#include "csapp.h"
+#include "tinylfu.h"
+
+// 캐시 크기 상수 정의
+#define MAX_CACHE_SIZE 1049000
+#define MAX_OBJECT_SIZE 102400
+#define CACHE_INIT_SLOTS 64     // 해시 인덱스의 초기 슬롯 수 (2의 거듭제곱)
+#define CACHE_NSHARDS 16        // 캐시 하나를 나누는 최대 락 스트라이프 수
+#define CACHE_PROMOTE_BATCH 64  // 스트라이프마다 모아 두었다가 한꺼번에 반영할 LRU 승격 수
+#define CACHE_MEMFD_MIN (16 * 1024) // memfd 저장을 켰을 때 memfd로 옮길 가장 작은 본문 크기
+
+// 응답 헤더 끝에 클라이언트 연결마다 붙이는 Connection 필드 (저장된 헤더에는 홉별 필드가 없음)
+#define CONN_KEEP_ALIVE "Connection: keep-alive\r\n"
+#define CONN_CLOSE      "Connection: close\r\n"
+
+/**
+ * web_object_t 구조체: 웹 캐시에 저장되는 객체의 정보를 저장합니다.
+ * 검색과 LRU 갱신에 쓰는 필드를 캐시 라인 하나(64바이트)에 모으고, 키는 그 뒤에 가변 길이로 둡니다.
+ * hash: path의 64비트 해시 (인덱스 검색 시 문자열보다 먼저 비교)
+ * prev, next: 이중 연결 리스트에서의 이전 및 다음 객체를 가리키는 포인터
+ * response_ptr: 객체 콘텐츠를 가리키는 포인터 (슬랩 청크)
+ * body_fd: 본문을 담은 봉인된 memfd (memfd가 1일 때 response_ptr 대신 사용)
+ * refcnt: 참조 수 (캐시 자신의 참조 1 + 객체를 전송 중인 스레드와 승격 버퍼의 참조)
+ * content_length: 객체의 콘텐츠 길이
+ * alloc_size: 캐시 크기 제한에 매기는 크기 (객체와 본문이 차지하는 슬랩 청크의 크기 합)
+ * path_len: path의 길이 (NUL 제외)
+ * promote_pending: 승격 버퍼에 들어 있으면 1
+ * cached: 캐시에 연결되어 있으면 1 (스트라이프 락 아래에서만 읽고 씀)
+ * expires: 신선하지 않게 되는 시각 (RFC 9111, 이 시각부터는 원격 서버에 재검증)
+ * heap_idx: GDSF 정책의 힙에서의 자리
+ * freq: 교체 정책의 적중 표시 (CLOCK의 참조 비트, S3-FIFO와 GDSF의 빈도)
+ * qtag: 교체 정책이 쓰는 표시 (S3-FIFO의 큐, GDSF가 우선순위를 계산할 때의 빈도)
+ * hdr_len: 저장한 상태 줄과 헤더(빈 줄 포함)의 길이
+ * memfd: 본문이 memfd에 있으면 1
+ * path: 객체의 URI 경로 (구조체 바로 뒤에 NUL까지 저장하고, 이어서 응답 헤더를 NUL까지 저장)
+ */
+typedef struct web_object_t
+{
+  uint64_t hash;
+  struct web_object_t *prev, *next;
+  union
+  {
+    char *response_ptr;
+    long body_fd;
+  };
+  uint32_t refcnt;
+  int content_length;
+  uint32_t alloc_size;
+  uint16_t path_len;
+  uint8_t promote_pending;
+  uint8_t cached;
+  time_t expires;
+  uint32_t heap_idx;
+  uint8_t freq;
+  uint8_t qtag;
+  uint16_t hdr_len : 15; // MAXLINE 이하
+  uint16_t memfd : 1;
+  char path[];
+} __attribute__((aligned(64))) web_object_t;
+
+/**
+ * cache_header 함수: 객체에 키 뒤에 이어서 저장된 응답 상태 줄과 헤더를 반환합니다 (NUL로 끝남).
+ */
+static inline char *cache_header(web_object_t *web_object)
+{
+  return web_object->path + web_object->path_len + 1;
+}
+
+/**
+ * cache_index_t 구조체: 객체를 가리키는 개방 주소법(선형 탐사) 해시 테이블입니다.
+ * 읽는 쪽은 락 없이 탐사하므로, 제거는 묘비를 남기고 테이블을 키우거나 정리할 때는
+ * 새 테이블을 만들어 통째로 바꿉니다 (옛 테이블은 에포크가 지난 뒤 해제).
+ */
+typedef struct cache_index_t
+{
+  size_t nslots;
+  web_object_t *slots[];
+} cache_index_t;
+
+/**
+ * cache_shard_t 구조체: 뮤텍스 하나가 보호하는 캐시 스트라이프입니다.
+ * lock: 삽입/제거/교체 정책의 재배열을 보호 (검색은 락을 잡지 않음)
+ * rootp, lastp: 교체 정책이 쓰는 리스트의 앞과 끝 (LRU면 가장 최근/가장 오래전에 사용된 객체)
+ * index: 해시 인덱스, nobjects/ntombs: 인덱스에 든 객체와 묘비의 수
+ * total_cache_size: 현재 스트라이프의 객체들이 차지하는 슬랩 청크의 총 크기
+ * max_cache_size: 이 스트라이프의 최대 크기
+ * promote, npromote: 적중한 객체들 (락을 잡은 쪽이 리스트를 바꾸기 전에 앞으로 옮김)
+ * lfu: 이 스트라이프 키들의 접근 빈도 추정기 (입장 허가에 사용)
+ * policy_state: 교체 정책의 스트라이프별 상태
+ */
+typedef struct cache_shard_t
+{
+  pthread_mutex_t lock;
+  web_object_t *rootp;
+  web_object_t *lastp;
+  cache_index_t *index;
+  size_t nobjects;
+  size_t ntombs;
+  size_t total_cache_size;
+  size_t max_cache_size;
+  unsigned npromote;
+  web_object_t *promote[CACHE_PROMOTE_BATCH];
+  tinylfu_t lfu;
+  void *policy_state;
+} __attribute__((aligned(64))) cache_shard_t;
+
+/**
+ * cache_policy_t 구조체: 교체 정책의 함수 테이블입니다 (구현은 policy.c).
+ * hit만 락 없이 (적중한 객체의 참조를 가진 상태로) 불리고, 나머지는 스트라이프 락 아래에서 불립니다.
+ * init: 스트라이프의 정책 상태를 만듦
+ * flush: 미뤄 둔 일을 반영함 (삽입이나 제거 전에 불림)
+ * hit: 적중을 기록함
+ * insert: 새 객체를 넣음
+ * victim: 다음에 내보낼 객체를 고름 (떼어내지는 않음, 고르면서 순서를 바꿀 수 있음)
+ * peek: prev 다음에 내보낼 객체를 미리 봄 (prev가 NULL이면 첫 객체, 정책의 상태를 바꾸지 않음)
+ * remove: 객체를 정책의 자료구조에서 떼어냄
+ * fini: 스트라이프의 정책 상태를 해제함
+ */
+typedef struct cache_policy_t
+{
+  const char *name;
+  void (*init)(cache_shard_t *shard);
+  void (*flush)(cache_shard_t *shard);
+  void (*hit)(cache_shard_t *shard, web_object_t *obj);
+  void (*insert)(cache_shard_t *shard, web_object_t *obj);
+  web_object_t *(*victim)(cache_shard_t *shard);
+  web_object_t *(*peek)(cache_shard_t *shard, web_object_t *prev);
+  void (*remove)(cache_shard_t *shard, web_object_t *obj);
+  void (*fini)(cache_shard_t *shard);
+} cache_policy_t;
+
+/**
+ * cache_t 구조체: 경로의 해시로 나뉜 스트라이프들로 이루어진 캐시입니다.
+ * shards, nshards: 스트라이프 배열과 그 수
+ * max_cache_size: 캐시 전체의 최대 크기 (스트라이프마다 균등하게 나눔)
+ * admission: 1이면 객체를 내보내야 할 때 TinyLFU로 새 객체의 입장을 허가 (기본값 1)
+ * memfd: 1이면 CACHE_MEMFD_MIN 이상의 본문을 memfd에 두고 sendfile로 보냄 (기본값 0)
+ * policy: 교체 정책
+ */
+typedef struct cache_t
+{
+  cache_shard_t *shards;
+  int nshards;
+  size_t max_cache_size;
+  int admission;
+  int memfd;
+  const cache_policy_t *policy;
+} cache_t;
+
+// 프로세스 전체가 공유하는 기본 캐시 (thread, pool, epoll, uring, coro 모드)
+extern cache_t proxy_cache;
+
+// 교체 정책 (policy.c)
+extern const cache_policy_t lru_policy, clock_policy, s3fifo_policy, gdsf_policy;
+extern const cache_policy_t *cache_policies[]; // NULL로 끝나는 모든 정책의 목록
+const cache_policy_t *cache_find_policy(const char *name);
+
+// 캐시 함수 선언
+void cache_init(cache_t *cache, size_t max_cache_size, const cache_policy_t *policy);
+void cache_deinit(cache_t *cache);
+uint64_t cache_hash(const char *key);
+web_object_t *new_cache_object(char *path, char *hdr, size_t hdr_len, char *body, int content_length);
+web_object_t *clone_cache_object(web_object_t *web_object, char *hdr, size_t hdr_len);
+void free_cache_object(web_object_t *web_object);
+web_object_t *lookup_cache(cache_t *cache, char *path);
+void release_cache(web_object_t *web_object);
+int send_cache(web_object_t *web_object, int clientfd, int keepalive);
+char *dup_cache_response(web_object_t *web_object, size_t *len, int keepalive);
+void write_cache(cache_t *cache, web_object_t *web_object);
+
+#endif /* __CACHE_H__ */
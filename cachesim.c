@@ -0,0 +1,348 @@
+#include <math.h>
+#include <time.h>
+#include "cache.h"
+#include "slab.h"
+
+/*
+ * cachesim.c - 캐시 시뮬레이터
+ *
+ * 프록시와 같은 캐시 모듈(cache.c, policy.c, tinylfu.c, slab.c)에 접근 기록을 재생해서
+ * 캐시 크기, 교체 정책, 입장 허가(TinyLFU) 조합별로 적중률, 바이트 적중률, 초당 처리량을
+ * 잽니다. 재생은 프록시의 적중 경로와 같이 lookup_cache로 찾고, 없으면 본문을 슬랩에서
+ * 받아 write_cache로 넣습니다. MAX_OBJECT_SIZE 같은 상수를 바꾸기 전에 실제 기록으로
+ * 효과를 확인하는 용도입니다.
+ *
+ * 기록 파일은 한 줄에 요청 하나씩 "URI 크기 [시각]" 형식입니다 (#으로 시작하는 줄은 무시).
+ * -g로 Zipf 분포를 따르는 합성 기록을 같은 형식으로 만들 수 있습니다.
+ *
+ *   ./cachesim -g 1000000 -u 20000 -z 0.9 > zipf.trace
+ *   ./cachesim -c 256K,1M,4M -e all -a both zipf.trace
+ */
+
+#define SIM_MAX_SIZES 32       // -c로 줄 수 있는 캐시 크기 수
+#define SIM_INIT_URIS 1024     // URI 인턴 표의 처음 크기
+#define SIM_GEN_URIS 10000     // -g: 기본 URI 수
+#define SIM_GEN_ALPHA 0.9      // -g: 기본 Zipf 지수
+#define SIM_GEN_MIN_SIZE 256   // -g: 가장 작은 객체 크기
+#define SIM_GEN_SIZE_SHIFT 10  // -g: 객체 크기는 최소 크기의 2^0 ~ 2^10배 (256B ~ 256KB)
+
+/**
+ * sim_req_t 구조체: 기록의 요청 하나입니다.
+ * uri: 인턴된 URI (같은 URI는 같은 포인터), size: 응답 본문 크기
+ */
+typedef struct sim_req_t
+{
+  char *uri;
+  int size;
+} sim_req_t;
+
+/**
+ * sim_trace_t 구조체: 메모리에 읽어 들인 기록입니다.
+ * reqs, nreqs, cap: 요청 배열과 요청 수, 배열 크기
+ * uris, nuris, nslots: URI 인턴 표 (열린 주소법)와 서로 다른 URI 수, 표 크기
+ * bytes: 요청된 바이트 합, first_ts/last_ts: 첫 요청과 마지막 요청의 시각
+ */
+typedef struct sim_trace_t
+{
+  sim_req_t *reqs;
+  size_t nreqs, cap;
+  char **uris;
+  size_t nuris, nslots;
+  double bytes;
+  double first_ts, last_ts;
+} sim_trace_t;
+
+static void usage(char *prog)
+{
+  fprintf(stderr, "usage: %s [-c size,...] [-e policy,...|all] [-a on|off|both] [-o max_object] <trace>\n", prog);
+  fprintf(stderr, "       %s -g requests [-u uris] [-z alpha] [-S seed] > <trace>\n", prog);
+  exit(1);
+}
+
+/**
+ * parse_size 함수: "256K", "4M" 같은 크기 문자열을 바이트 수로 바꿉니다.
+ * 반환: 바이트 수, 잘못된 문자열이면 0
+ */
+static size_t parse_size(char *s)
+{
+  char *end;
+  double v = strtod(s, &end);
+
+  switch (*end)
+  {
+  case 'k': case 'K': v *= 1024; end++; break;
+  case 'm': case 'M': v *= 1024 * 1024; end++; break;
+  case 'g': case 'G': v *= 1024 * 1024 * 1024; end++; break;
+  }
+  if (*end || v < 1)
+    return 0;
+  return (size_t)v;
+}
+
+/**
+ * trace_intern 함수: URI를 인턴 표에서 찾고, 없으면 복사해서 넣습니다.
+ * 같은 URI의 요청들이 문자열 하나를 같이 쓰므로 기록의 메모리가 서로 다른 URI 수에 비례합니다.
+ */
+static char *trace_intern(sim_trace_t *t, char *uri)
+{
+  size_t mask, i, j;
+  char **old;
+
+  if ((t->nuris + 1) * 2 > t->nslots) // 표를 반 이하로 채움
+  {
+    old = t->uris;
+    t->uris = Calloc(t->nslots * 2, sizeof(char *));
+    mask = t->nslots * 2 - 1;
+    for (i = 0; i < t->nslots; i++)
+      if (old[i])
+      {
+        for (j = cache_hash(old[i]) & mask; t->uris[j]; j = (j + 1) & mask)
+          ;
+        t->uris[j] = old[i];
+      }
+    t->nslots *= 2;
+    free(old);
+  }
+
+  mask = t->nslots - 1;
+  for (i = cache_hash(uri) & mask; t->uris[i]; i = (i + 1) & mask)
+    if (!strcmp(t->uris[i], uri))
+      return t->uris[i];
+  t->uris[i] = strdup(uri);
+  t->nuris++;
+  return t->uris[i];
+}
+
+/**
+ * trace_load 함수: 기록 파일을 읽어 들입니다. 형식이 맞지 않는 줄은 경고하고 건너뜁니다.
+ */
+static void trace_load(sim_trace_t *t, char *filename)
+{
+  FILE *fp;
+  char line[MAXLINE], uri[MAXLINE];
+  double ts;
+  int size, n;
+  size_t lineno = 0;
+
+  if (!(fp = fopen(filename, "r")))
+    unix_error("fopen error");
+
+  memset(t, 0, sizeof(*t));
+  t->nslots = SIM_INIT_URIS;
+  t->uris = Calloc(t->nslots, sizeof(char *));
+  while (fgets(line, MAXLINE, fp))
+  {
+    lineno++;
+    if (line[0] == '#' || line[0] == '\n')
+      continue;
+    if ((n = sscanf(line, "%s %d %lf", uri, &size, &ts)) < 2 || size < 0)
+    {
+      fprintf(stderr, "%s:%zu: malformed line, skipped\n", filename, lineno);
+      continue;
+    }
+    if (n == 3)
+    {
+      if (!t->nreqs)
+        t->first_ts = ts;
+      t->last_ts = ts;
+    }
+
+    if (t->nreqs == t->cap)
+    {
+      t->cap = t->cap ? t->cap * 2 : 4096;
+      t->reqs = Realloc(t->reqs, t->cap * sizeof(sim_req_t));
+    }
+    t->reqs[t->nreqs].uri = trace_intern(t, uri);
+    t->reqs[t->nreqs].size = size;
+    t->nreqs++;
+    t->bytes += size;
+  }
+  fclose(fp);
+}
+
+/**
+ * trace_generate 함수: Zipf(alpha) 분포로 URI를 고르는 합성 기록을 표준 출력에 씁니다.
+ * 순위 k인 URI가 뽑힐 확률은 1/k^alpha에 비례합니다. URI마다 크기를 하나 정해 두며,
+ * 크기는 로그 스케일에서 고르게 퍼지므로 MAX_OBJECT_SIZE보다 큰 객체도 섞입니다.
+ * 시각은 1ms 간격으로 늘어납니다.
+ */
+static void trace_generate(long nreqs, int nuris, double alpha, unsigned seed)
+{
+  double *cdf = Malloc(nuris * sizeof(double));
+  int *sizes = Malloc(nuris * sizeof(int));
+  double sum = 0, u;
+  int i, lo, hi, mid;
+  long r;
+
+  srand(seed);
+  for (i = 0; i < nuris; i++)
+  {
+    sum += 1.0 / pow(i + 1, alpha);
+    cdf[i] = sum;
+    sizes[i] = SIM_GEN_MIN_SIZE << (rand() % (SIM_GEN_SIZE_SHIFT + 1));
+    sizes[i] += rand() % sizes[i];
+  }
+
+  printf("# zipf alpha=%.2f uris=%d requests=%ld seed=%u\n", alpha, nuris, nreqs, seed);
+  for (r = 0; r < nreqs; r++)
+  {
+    u = (double)rand() / RAND_MAX * sum;
+    lo = 0;
+    hi = nuris - 1;
+    while (lo < hi) // u <= cdf[lo]인 가장 작은 lo
+    {
+      mid = (lo + hi) / 2;
+      if (cdf[mid] < u)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+    printf("/obj/%d %d %.3f\n", lo, sizes[lo], r / 1000.0);
+  }
+  free(cdf);
+  free(sizes);
+}
+
+/**
+ * simulate 함수: 기록을 캐시 하나에 재생하고 결과 한 줄을 출력합니다.
+ * slab_bytes는 재생을 마쳤을 때 캐시된 객체들이 차지한 슬랩 페이지의 크기입니다.
+ * max_object보다 큰 응답은 프록시처럼 캐시하지 않고 실패로 셉니다.
+ */
+static void simulate(sim_trace_t *t, size_t cache_size, const cache_policy_t *policy,
+                     int admission, int max_object)
+{
+  cache_t cache;
+  web_object_t *obj;
+  struct timespec start, end;
+  double hit_bytes = 0, secs;
+  size_t hits = 0, i;
+  char hdr[MAXLINE];
+  int hdr_len;
+  sim_req_t *req;
+
+  cache_init(&cache, cache_size, policy);
+  cache.admission = admission;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (i = 0; i < t->nreqs; i++)
+  {
+    req = &t->reqs[i];
+    if ((obj = lookup_cache(&cache, req->uri)))
+    {
+      hits++;
+      hit_bytes += obj->content_length;
+      release_cache(obj);
+    }
+    else if (req->size <= max_object)
+    {
+      // 크기 매김이 프록시와 같도록 짧은 응답 헤더를 함께 저장
+      hdr_len = sprintf(hdr, "HTTP/1.0 200 OK\r\nContent-length: %d\r\n\r\n", req->size);
+      write_cache(&cache, new_cache_object(req->uri, hdr, hdr_len, slab_alloc(req->size), req->size));
+    }
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+  printf("%-8s %-5s %12zu %9.4f %9.4f %12.0f %12zu\n", cache.policy->name, admission ? "on" : "off",
+         cache_size, (double)hits / t->nreqs, t->bytes > 0 ? hit_bytes / t->bytes : 0,
+         secs > 0 ? t->nreqs / secs : 0, slab_footprint());
+  cache_deinit(&cache);
+}
+
+int main(int argc, char **argv)
+{
+  sim_trace_t trace;
+  const cache_policy_t *policies[8];
+  size_t sizes[SIM_MAX_SIZES];
+  int npolicies = 0, nsizes = 0, admit_lo = 1, admit_hi = 1;
+  int max_object = MAX_OBJECT_SIZE, nuris = SIM_GEN_URIS, opt, p, s, a;
+  long generate = 0;
+  double alpha = SIM_GEN_ALPHA;
+  unsigned seed = 1;
+  char *tok;
+
+  while ((opt = getopt(argc, argv, "c:e:a:o:g:u:z:S:")) != -1)
+  {
+    switch (opt)
+    {
+    case 'c':
+      for (tok = strtok(optarg, ","); tok; tok = strtok(NULL, ","))
+        if (nsizes == SIM_MAX_SIZES || !(sizes[nsizes++] = parse_size(tok)))
+          usage(argv[0]);
+      break;
+    case 'e':
+      for (tok = strtok(optarg, ","); tok; tok = strtok(NULL, ","))
+      {
+        if (!strcmp(tok, "all"))
+          for (npolicies = 0; cache_policies[npolicies]; npolicies++)
+            policies[npolicies] = cache_policies[npolicies];
+        else if (npolicies == 8 || !(policies[npolicies++] = cache_find_policy(tok)))
+          usage(argv[0]);
+      }
+      break;
+    case 'a':
+      if (!strcmp(optarg, "both"))
+        admit_lo = 0, admit_hi = 1;
+      else if (!strcmp(optarg, "on") || !strcmp(optarg, "off"))
+        admit_lo = admit_hi = !strcmp(optarg, "on");
+      else
+        usage(argv[0]);
+      break;
+    case 'o':
+      max_object = atoi(optarg);
+      if (max_object < 0 || max_object > MAX_OBJECT_SIZE)
+      {
+        fprintf(stderr, "max_object must be 0..%d (slab chunk limit)\n", MAX_OBJECT_SIZE);
+        exit(1);
+      }
+      break;
+    case 'g':
+      generate = atol(optarg);
+      break;
+    case 'u':
+      nuris = atoi(optarg);
+      break;
+    case 'z':
+      alpha = atof(optarg);
+      break;
+    case 'S':
+      seed = atoi(optarg);
+      break;
+    default:
+      usage(argv[0]);
+    }
+  }
+
+  if (generate)
+  {
+    if (generate < 0 || nuris < 1 || alpha <= 0)
+      usage(argv[0]);
+    trace_generate(generate, nuris, alpha, seed);
+    return 0;
+  }
+  if (optind != argc - 1)
+    usage(argv[0]);
+
+  if (!nsizes)
+    sizes[nsizes++] = MAX_CACHE_SIZE;
+  if (!npolicies)
+    policies[npolicies++] = &lru_policy;
+
+  trace_load(&trace, argv[optind]);
+  if (!trace.nreqs)
+  {
+    fprintf(stderr, "%s: no requests\n", argv[optind]);
+    exit(1);
+  }
+  printf("# %zu requests, %zu uris, %.0f bytes, %.3f s span, max_object %d\n", trace.nreqs,
+         trace.nuris, trace.bytes, trace.last_ts - trace.first_ts, max_object);
+  printf("%-8s %-5s %12s %9s %9s %12s %12s\n", "policy", "admit", "cache_size", "hit", "byte_hit", "ops/sec",
+         "slab_bytes");
+
+  slab_init(0);
+  for (s = 0; s < nsizes; s++)
+    for (p = 0; p < npolicies; p++)
+      for (a = admit_lo; a <= admit_hi; a++)
+        simulate(&trace, sizes[s], policies[p], a, max_object);
+  return 0;
+}
@@ -0,0 +1,280 @@
+#define _GNU_SOURCE
+#include <sys/epoll.h>
+#include <ucontext.h>
+#include "proxy.h"
+
+/*
+ * coro.c - 코루틴 기반 연결 처리 모드
+ *
+ * 연결마다 작은 스택을 가진 코루틴(ucontext) 안에서 기존의 doit()를 그대로 실행합니다.
+ * 소켓은 논블로킹이며, Rio 함수나 open_clientfd가 EAGAIN을 만나면 rio_wait_hook을 통해
+ * coro_wait가 불려 fd를 epoll에 등록하고 스케줄러로 양보합니다. 스케줄러 스레드(코어당 하나)는
+ * epoll 이벤트가 오면 기다리던 코루틴을 이어서 실행합니다. 요청 처리 코드는 순차적인
+ * 모양을 유지하면서 스레드를 막지 않습니다.
+ *
+ * 제한 시간이 있는 대기(keep-alive 연결의 다음 요청 등)는 스케줄러의 타이머 목록에도 올라가며,
+ * 스케줄러는 CORO_TIMER_TICK마다 기한이 지난 코루틴을 epoll에서 빼고 시간 초과로 깨웁니다.
+ */
+
+#define CORO_MAXEVENTS 256 // epoll_wait 한 번에 처리할 최대 이벤트 수
+#define CORO_STACK_KB  256 // 코루틴 스택 기본 크기 (KB, 실제로 쓴 페이지만 메모리를 차지)
+#define CORO_TIMER_TICK 100 // 대기 기한을 확인하는 간격 (밀리초)
+
+/**
+ * coro_t 구조체: 연결 하나를 처리하는 코루틴입니다.
+ * ctx: 코루틴의 실행 문맥, stack: 스택 영역 (맨 아래 한 페이지는 보호 페이지)
+ * fd: 처리할 클라이언트 소켓, done: 연결 처리가 끝났으면 1
+ * next: 스택 재사용 목록의 다음 코루틴
+ * wait_fd, deadline: 제한 시간이 있는 대기 중인 fd와 기한 (단조 시계, 밀리초)
+ * timed_out: 마지막 대기가 시간 초과로 끝났으면 1
+ * timer_prev, timer_next: 스케줄러 타이머 목록의 이웃
+ */
+typedef struct coro_t
+{
+  ucontext_t ctx;
+  char *stack;
+  int fd;
+  int done;
+  struct coro_t *next;
+  int wait_fd, timed_out;
+  long deadline;
+  struct coro_t *timer_prev, *timer_next;
+} coro_t;
+
+/**
+ * sched_t 구조체: 스케줄러 스레드 하나의 상태입니다.
+ * ctx: 스케줄러 자신의 문맥 (코루틴이 양보하거나 끝나면 돌아오는 곳)
+ * free_coros: 끝난 코루틴 목록 (스택 재사용)
+ * timers: 제한 시간이 있는 대기 중인 코루틴 목록, next_sweep: 다음에 기한을 확인할 시각
+ */
+typedef struct sched_t
+{
+  int epfd;
+  int listenfd;
+  ucontext_t ctx;
+  coro_t *free_coros;
+  coro_t *timers;
+  long next_sweep;
+} sched_t;
+
+static size_t stack_size;             // 코루틴 스택 크기 (보호 페이지 포함)
+static __thread sched_t *sched;       // 현재 스레드의 스케줄러
+static __thread coro_t *current;      // 현재 실행 중인 코루틴 (스케줄러 문맥이면 NULL)
+
+/**
+ * coro_now 함수: 단조 시계의 현재 시각을 밀리초로 반환합니다.
+ */
+static long coro_now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000L + ts.tv_nsec / 1000000;
+}
+
+/**
+ * timer_remove 함수: 코루틴을 스케줄러의 타이머 목록에서 뺍니다.
+ */
+static void timer_remove(coro_t *co)
+{
+  if (co->timer_prev)
+    co->timer_prev->timer_next = co->timer_next;
+  else
+    sched->timers = co->timer_next;
+  if (co->timer_next)
+    co->timer_next->timer_prev = co->timer_prev;
+}
+
+/**
+ * coro_wait 함수: rio_wait_hook으로 등록되어, 현재 코루틴을 fd가 준비되거나 timeout이 지날 때까지 재웁니다.
+ * 코루틴 밖에서 불리면 poll로 기다립니다.
+ *
+ * fd: 기다릴 파일 디스크립터
+ * events: POLLIN 또는 POLLOUT (EPOLLIN, EPOLLOUT과 같은 값)
+ * timeout: 제한 시간 (밀리초, -1이면 제한 없음)
+ * 반환: 시간 초과면 0
+ */
+static int coro_wait(int fd, int events, int timeout)
+{
+  struct epoll_event ev;
+  struct pollfd pfd;
+  coro_t *co = current;
+
+  // 한 번만 깨우도록 EPOLLONESHOT으로 등록 (처음이면 ADD, 이미 등록된 fd면 MOD)
+  ev.events = events | EPOLLONESHOT;
+  ev.data.ptr = co;
+  if (co && (epoll_ctl(sched->epfd, EPOLL_CTL_MOD, fd, &ev) == 0 ||
+             epoll_ctl(sched->epfd, EPOLL_CTL_ADD, fd, &ev) == 0))
+  {
+    co->timed_out = 0;
+    if (timeout >= 0)
+    {
+      co->wait_fd = fd;
+      co->deadline = coro_now() + timeout;
+      co->timer_prev = NULL;
+      co->timer_next = sched->timers;
+      if (sched->timers)
+        sched->timers->timer_prev = co;
+      sched->timers = co;
+    }
+    swapcontext(&co->ctx, &sched->ctx);
+    if (timeout >= 0 && !co->timed_out)
+      timer_remove(co); // fd가 준비되어 깨어남 (시간 초과면 스케줄러가 이미 뺌)
+    return !co->timed_out;
+  }
+
+  // 코루틴 밖이거나 epoll에 등록할 수 없으면 이 스레드에서 기다림
+  pfd.fd = fd;
+  pfd.events = events;
+  return poll(&pfd, 1, timeout) != 0;
+}
+
+/**
+ * coro_entry 함수: 코루틴의 시작 함수입니다. 클라이언트 연결의 요청들을 처리하고 연결을 닫습니다.
+ * 반환하면 uc_link에 따라 스케줄러 문맥으로 돌아갑니다.
+ */
+static void coro_entry(void)
+{
+  coro_t *co = current;
+
+  serve_client(co->fd);
+  Close(co->fd);
+  co->done = 1;
+}
+
+/**
+ * coro_resume 함수: 코루틴을 양보하거나 끝날 때까지 실행합니다.
+ * 끝난 코루틴은 스택 재사용 목록으로 돌려보냅니다.
+ */
+static void coro_resume(coro_t *co)
+{
+  current = co;
+  swapcontext(&sched->ctx, &co->ctx);
+  current = NULL;
+  if (co->done)
+  {
+    co->next = sched->free_coros;
+    sched->free_coros = co;
+  }
+}
+
+/**
+ * coro_spawn 함수: 클라이언트 연결 하나를 처리할 코루틴을 만들고 바로 실행합니다.
+ * 스택은 재사용 목록에서 꺼내거나, 없으면 맨 아래에 보호 페이지를 둔 mmap 영역을 만듭니다.
+ */
+static void coro_spawn(int clientfd)
+{
+  coro_t *co = sched->free_coros;
+  size_t page = sysconf(_SC_PAGESIZE);
+
+  if (co)
+    sched->free_coros = co->next;
+  else
+  {
+    co = Malloc(sizeof(coro_t));
+    co->stack = mmap(NULL, stack_size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK, -1, 0);
+    if (co->stack == MAP_FAILED)
+    {
+      free(co);
+      close(clientfd);
+      return;
+    }
+    mprotect(co->stack, page, PROT_NONE); // 스택 넘침을 잡는 보호 페이지
+  }
+
+  co->fd = clientfd;
+  co->done = 0;
+  getcontext(&co->ctx);
+  co->ctx.uc_stack.ss_sp = co->stack + page;
+  co->ctx.uc_stack.ss_size = stack_size - page;
+  co->ctx.uc_link = &sched->ctx;
+  makecontext(&co->ctx, coro_entry, 0);
+  coro_resume(co);
+}
+
+/**
+ * coro_sweep 함수: 대기 기한이 지난 코루틴들을 epoll에서 빼고 시간 초과로 깨웁니다.
+ * 이번 배치의 이벤트를 모두 처리한 뒤에 부르므로 같은 대기가 두 번 깨어나지 않습니다.
+ */
+static void coro_sweep(long now)
+{
+  coro_t *co, *next;
+
+  sched->next_sweep = now + CORO_TIMER_TICK;
+  for (co = sched->timers; co; co = next)
+  {
+    next = co->timer_next; // 깨어난 코루틴은 자기 자신만 목록에서 빼거나 다시 넣음
+    if (co->deadline > now)
+      continue;
+    timer_remove(co);
+    epoll_ctl(sched->epfd, EPOLL_CTL_DEL, co->wait_fd, NULL);
+    co->timed_out = 1;
+    coro_resume(co);
+  }
+}
+
+/**
+ * coro_loop 함수: 스케줄러 스레드의 본체입니다. 새 연결마다 코루틴을 만들고,
+ * 기다리던 fd가 준비되면 해당 코루틴을 이어서 실행하며, 대기 기한이 지난 코루틴을 깨웁니다.
+ *
+ * vargp: 이 스레드의 sched_t 포인터
+ */
+static void *coro_loop(void *vargp)
+{
+  struct epoll_event ev, events[CORO_MAXEVENTS];
+  int i, n, clientfd;
+
+  sched = (sched_t *)vargp;
+  if ((sched->epfd = epoll_create1(EPOLL_CLOEXEC)) < 0)
+    unix_error("epoll_create1 error");
+  ev.events = EPOLLIN | EPOLLEXCLUSIVE;
+  ev.data.ptr = NULL;
+  if (epoll_ctl(sched->epfd, EPOLL_CTL_ADD, sched->listenfd, &ev) < 0)
+    unix_error("epoll_ctl error");
+
+  while (1)
+  {
+    if ((n = epoll_wait(sched->epfd, events, CORO_MAXEVENTS, sched->timers ? CORO_TIMER_TICK : -1)) < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      unix_error("epoll_wait error");
+    }
+    for (i = 0; i < n; i++)
+    {
+      if (events[i].data.ptr)
+        coro_resume(events[i].data.ptr);
+      else
+        while ((clientfd = accept4(sched->listenfd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0)
+          coro_spawn(clientfd);
+    }
+    if (sched->timers && coro_now() >= sched->next_sweep)
+      coro_sweep(coro_now());
+  }
+  return NULL;
+}
+
+/**
+ * coro_main 함수: coro 모드의 진입점입니다. Rio의 대기 훅을 설치하고 nsched개의
+ * 스케줄러 스레드를 실행합니다. 호출한 스레드도 스케줄러 하나를 맡으며 반환하지 않습니다.
+ *
+ * listenfd: 리스닝 소켓
+ * nsched: 스케줄러 스레드 수
+ * stack_kb: 코루틴 스택 크기 (KB, 0이면 기본값)
+ */
+void coro_main(int listenfd, int nsched, int stack_kb)
+{
+  pthread_t tid;
+  int i;
+  sched_t *scheds = Calloc(nsched, sizeof(sched_t));
+
+  stack_size = (size_t)(stack_kb > 0 ? stack_kb : CORO_STACK_KB) * 1024 + sysconf(_SC_PAGESIZE);
+  rio_wait_hook = coro_wait;
+  fcntl(listenfd, F_SETFL, fcntl(listenfd, F_GETFL) | O_NONBLOCK);
+  for (i = 0; i < nsched; i++)
+    scheds[i].listenfd = listenfd;
+  for (i = 1; i < nsched; i++)
+    Pthread_create(&tid, NULL, coro_loop, &scheds[i]);
+  coro_loop(&scheds[0]);
+}
@@ -742,6 +742,41 @@ void V(sem_t *sem)
  * The Rio package - Robust I/O functions
  ****************************************/
 
+/*
+ * rio_wait_hook - If set, called instead of poll() when a Rio function
+ *     hits EAGAIN on a non-blocking descriptor, so that a cooperative
+ *     scheduler can switch to another task until fd becomes ready.
+ *     events is POLLIN or POLLOUT; timeout is in milliseconds (-1 waits
+ *     forever). Returns 0 if the timeout expired, nonzero otherwise.
+ */
+int (*rio_wait_hook)(int fd, int events, int timeout) = NULL;
+
+/*
+ * rio_wait_timeout - Wait up to timeout ms until fd is ready for events.
+ *     Returns 0 if the timeout expired, nonzero otherwise.
+ */
+int rio_wait_timeout(int fd, int events, int timeout)
+{
+    struct pollfd pfd;
+    int rc;
+
+    if (rio_wait_hook)
+        return rio_wait_hook(fd, events, timeout);
+    pfd.fd = fd;
+    pfd.events = events;
+    while ((rc = poll(&pfd, 1, timeout)) < 0 && errno == EINTR)
+        ;
+    return rc != 0;
+}
+
+/*
+ * rio_wait - Wait until fd is ready for events
+ */
+void rio_wait(int fd, int events)
+{
+    rio_wait_timeout(fd, events, -1);
+}
+
 /*
  * rio_readn - Robustly read n bytes (unbuffered)
  */
@@ -756,6 +791,10 @@ ssize_t rio_readn(int fd, void *usrbuf, size_t n)
 	if ((nread = read(fd, bufp, nleft)) < 0) {
 	    if (errno == EINTR) /* Interrupted by sig handler return */
 		nread = 0;      /* and call read() again */
+	    else if (errno == EAGAIN) { /* Non-blocking fd not ready */
+		rio_wait(fd, POLLIN);
+		nread = 0;
+	    }
 	    else
 		return -1;      /* errno set by read() */ 
 	} 
@@ -782,6 +821,10 @@ ssize_t rio_writen(int fd, void *usrbuf, size_t n)
 	if ((nwritten = write(fd, bufp, nleft)) <= 0) {
 	    if (errno == EINTR)  /* Interrupted by sig handler return */
 		nwritten = 0;    /* and call write() again */
+	    else if (errno == EAGAIN) { /* Non-blocking fd not ready */
+		rio_wait(fd, POLLOUT);
+		nwritten = 0;
+	    }
 	    else
 		return -1;       /* errno set by write() */
 	}
@@ -792,6 +835,94 @@ ssize_t rio_writen(int fd, void *usrbuf, size_t n)
 }
 /* $end rio_writen */
 
+/*
+ * rio_writev - Robustly write all bytes of an iovec array (unbuffered).
+ *     The iovec array is modified to track partial writes.
+ */
+ssize_t rio_writev(int fd, struct iovec *iov, int iovcnt)
+{
+    size_t n = 0;
+    ssize_t nwritten;
+    int i;
+
+    for (i = 0; i < iovcnt; i++)
+	n += iov[i].iov_len;
+    while (iovcnt > 0) {
+	if ((nwritten = writev(fd, iov, iovcnt)) <= 0) {
+	    if (errno == EINTR)  /* Interrupted by sig handler return */
+		nwritten = 0;    /* and call writev() again */
+	    else if (errno == EAGAIN) { /* Non-blocking fd not ready */
+		rio_wait(fd, POLLOUT);
+		nwritten = 0;
+	    }
+	    else
+		return -1;       /* errno set by writev() */
+	}
+	while (iovcnt > 0 && (size_t)nwritten >= iov->iov_len) {
+	    nwritten -= iov->iov_len;
+	    iov++;
+	    iovcnt--;
+	}
+	if (iovcnt > 0) {
+	    iov->iov_base = (char *)iov->iov_base + nwritten;
+	    iov->iov_len -= nwritten;
+	}
+    }
+    return n;
+}
+
+/*
+ * rio_sendmore - Robustly send n bytes on a socket with MSG_MORE, so
+ *     they are held back and coalesced with the data that follows.
+ */
+ssize_t rio_sendmore(int fd, void *usrbuf, size_t n)
+{
+    size_t nleft = n;
+    ssize_t nwritten;
+    char *bufp = usrbuf;
+
+    while (nleft > 0) {
+	if ((nwritten = send(fd, bufp, nleft, MSG_MORE)) <= 0) {
+	    if (errno == EINTR)
+		nwritten = 0;
+	    else if (errno == EAGAIN) {
+		rio_wait(fd, POLLOUT);
+		nwritten = 0;
+	    }
+	    else
+		return -1;
+	}
+	nleft -= nwritten;
+	bufp += nwritten;
+    }
+    return n;
+}
+
+/*
+ * rio_sendfile - Robustly copy n bytes at offset off of in_fd to out_fd
+ *     inside the kernel (no user-space copy)
+ */
+ssize_t rio_sendfile(int out_fd, int in_fd, off_t off, size_t n)
+{
+    size_t nleft = n;
+    ssize_t nwritten;
+
+    while (nleft > 0) {
+	if ((nwritten = sendfile(out_fd, in_fd, &off, nleft)) <= 0) {
+	    if (nwritten < 0 && errno == EINTR)
+		nwritten = 0;
+	    else if (nwritten < 0 && errno == EAGAIN) {
+		rio_wait(out_fd, POLLOUT);
+		nwritten = 0;
+	    }
+	    else
+		return -1;  /* errno set by sendfile(), or in_fd too short */
+	}
+	nleft -= nwritten;
+    }
+    return n;
+}
+
 
 /* 
  * rio_read - This is a wrapper for the Unix read() function that
@@ -810,7 +941,9 @@ static ssize_t rio_read(rio_t *rp, char *usrbuf, size_t n)
 	rp->rio_cnt = read(rp->rio_fd, rp->rio_buf, 
 			   sizeof(rp->rio_buf));
 	if (rp->rio_cnt < 0) {
-	    if (errno != EINTR) /* Interrupted by sig handler return */
+	    if (errno == EAGAIN) /* Non-blocking fd not ready */
+		rio_wait(rp->rio_fd, POLLIN);
+	    else if (errno != EINTR) /* Interrupted by sig handler return */
 		return -1;
 	}
 	else if (rp->rio_cnt == 0)  /* EOF */
@@ -864,6 +997,27 @@ ssize_t rio_readnb(rio_t *rp, void *usrbuf, size_t n)
 }
 /* $end rio_readnb */
 
+/*
+ * rio_readsomeb - Read up to n bytes as soon as any are available
+ *     (buffered). Unread bytes in the internal buffer are returned
+ *     first; otherwise one read() goes straight into usrbuf, so a
+ *     relay forwards data as it arrives without an extra copy.
+ */
+ssize_t rio_readsomeb(rio_t *rp, void *usrbuf, size_t n)
+{
+    ssize_t nread;
+
+    if (rp->rio_cnt > 0)
+	return rio_read(rp, usrbuf, n);
+    while ((nread = read(rp->rio_fd, usrbuf, n)) < 0) {
+	if (errno == EAGAIN) /* Non-blocking fd not ready */
+	    rio_wait(rp->rio_fd, POLLIN);
+	else if (errno != EINTR)
+	    return -1;
+    }
+    return nread;
+}
+
 /* 
  * rio_readlineb - Robustly read a text line (buffered)
  */
@@ -948,7 +1102,7 @@ ssize_t Rio_readlineb(rio_t *rp, void *usrbuf, size_t maxlen)
  */
 /* $begin open_clientfd */
 int open_clientfd(char *hostname, char *port) {
-    int clientfd, rc;
+    int clientfd = -1, rc;
     struct addrinfo hints, *listp, *p;
 
     /* Get a list of potential server addresses */
@@ -962,26 +1116,39 @@ int open_clientfd(char *hostname, char *port) {
     }
   
     /* Walk the list for one that we can successfully connect to */
-    for (p = listp; p; p = p->ai_next) {
-        /* Create a socket descriptor */
-        if ((clientfd = socket(p->ai_family, p->ai_socktype, p->ai_protocol)) < 0) 
-            continue; /* Socket failed, try the next */
-
-        /* Connect to the server */
-        if (connect(clientfd, p->ai_addr, p->ai_addrlen) != -1) 
+    for (p = listp; p; p = p->ai_next)
+        if ((clientfd = connect_clientfd(p->ai_addr, p->ai_addrlen)) >= 0)
             break; /* Success */
-        if (close(clientfd) < 0) { /* Connect failed, try another */  //line:netp:openclientfd:closefd
-            fprintf(stderr, "open_clientfd: close failed: %s\n", strerror(errno));
-            return -1;
-        } 
-    } 
 
     /* Clean up */
     freeaddrinfo(listp);
-    if (!p) /* All connects failed */
+    return clientfd; /* -1 if all connects failed */
+}
+
+/*
+ * connect_clientfd - Open a TCP connection to one resolved address and
+ *     return the socket descriptor. Under a wait hook the socket is
+ *     non-blocking and the connect waits through rio_wait.
+ *
+ *     On error, returns -1 with errno set.
+ */
+int connect_clientfd(struct sockaddr *addr, socklen_t addrlen)
+{
+    int clientfd, err = 0;
+    socklen_t errlen = sizeof(err);
+
+    if ((clientfd = socket(addr->sa_family, SOCK_STREAM | (rio_wait_hook ? SOCK_NONBLOCK : 0), 0)) < 0)
         return -1;
-    else    /* The last connect succeeded */
+    if (connect(clientfd, addr, addrlen) != -1)
         return clientfd;
+    if (errno == EINPROGRESS) { /* Non-blocking connect: wait, then check */
+        rio_wait(clientfd, POLLOUT);
+        if (getsockopt(clientfd, SOL_SOCKET, SO_ERROR, &err, &errlen) == 0 && !err)
+            return clientfd;
+        errno = err;
+    }
+    close(clientfd);
+    return -1;
 }
 /* $end open_clientfd */
 
@@ -994,7 +1161,7 @@ int open_clientfd(char *hostname, char *port) {
  *       -1 with errno set for other errors.
  */
 /* $begin open_listenfd */
-int open_listenfd(char *port) 
+static int open_listenfd_opt(char *port, int reuseport) 
 {
     struct addrinfo hints, *listp, *p;
     int listenfd, rc, optval=1;
@@ -1019,6 +1186,13 @@ int open_listenfd(char *port)
         setsockopt(listenfd, SOL_SOCKET, SO_REUSEADDR,    //line:netp:csapp:setsockopt
                    (const void *)&optval , sizeof(int));
 
+        /* Let several sockets bind the same port (one per shard) */
+        if (reuseport && setsockopt(listenfd, SOL_SOCKET, SO_REUSEPORT,
+                                    (const void *)&optval, sizeof(int)) < 0) {
+            close(listenfd);
+            continue;
+        }
+
         /* Bind the descriptor to the address */
         if (bind(listenfd, p->ai_addr, p->ai_addrlen) == 0)
             break; /* Success */
@@ -1041,8 +1215,23 @@ int open_listenfd(char *port)
     }
     return listenfd;
 }
+
+int open_listenfd(char *port)
+{
+    return open_listenfd_opt(port, 0);
+}
 /* $end open_listenfd */
 
+/*
+ * open_listenfd_reuseport - Like open_listenfd, but sets SO_REUSEPORT so
+ *     that several listening sockets can share the port and the kernel
+ *     load-balances incoming connections among them.
+ */
+int open_listenfd_reuseport(char *port)
+{
+    return open_listenfd_opt(port, 1);
+}
+
 /****************************************************
  * Wrappers for reentrant protocol-independent helpers
  ****************************************************/
@@ -1064,6 +1253,15 @@ int Open_listenfd(char *port)
     return rc;
 }
 
+int Open_listenfd_reuseport(char *port) 
+{
+    int rc;
+
+    if ((rc = open_listenfd_reuseport(port)) < 0)
+	unix_error("Open_listenfd_reuseport error");
+    return rc;
+}
+
 /* $end csapp.c */
 
 
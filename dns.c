@@ -0,0 +1,465 @@
+#include <sys/eventfd.h>
+#include <sys/epoll.h>
+#include "dns.h"
+
+/*
+ * dns.c - 원격 서버 주소 캐시
+ *
+ * 캐시 미스마다 getaddrinfo로 이름을 해석하는 대신, (호스트, 포트)별로 해석한 주소를
+ * DNS_TTL 동안 기억합니다. 해석에 실패한 이름도 DNS_NEG_TTL 동안 기억하여 같은 실패를 반복해서
+ * 묻지 않습니다. 만료가 DNS_REFRESH_AHEAD 안으로 다가온 항목이 쓰이면 백그라운드에서 미리 다시
+ * 해석하므로, 자주 쓰는 원격 서버는 요청이 해석을 기다리지 않습니다.
+ *
+ * getaddrinfo는 블로킹이므로 해석은 해석 스레드(DNS_NTHREADS)만 합니다. 같은 이름을 기다리는
+ * 요청들은 해석 하나를 함께 기다리며, 끝나면 각자 등록한 eventfd로 깨어납니다 (flight.c와 같은 방식).
+ * 스레드 모드는 poll로, 코루틴 모드는 rio_wait_hook으로, 이벤트 루프는 epoll이나 io_uring으로
+ * 같은 eventfd를 기다립니다.
+ *
+ * 스레드 모드와 코루틴 모드의 연결(dns_open_clientfd)은 주소 후보들을 RFC 8305 (Happy Eyeballs)
+ * 방식으로 시차를 두고 함께 시도하므로, 응답하지 않는 주소 하나가 커널의 SYN 재전송 시간 동안
+ * 요청을 붙잡지 않습니다.
+ */
+
+/**
+ * dns_entry_t 구조체: 이름 하나의 해석 결과입니다.
+ * addrs, err, expires: 마지막 해석 결과 (err가 0이 아니면 실패)와 만료 시각 (valid일 때만 의미가 있음)
+ * resolving, job_next: 해석 스레드가 맡았거나 큐에 있으면 1, 해석 큐의 다음 항목
+ * watchers, nwatchers: 해석이 끝나면 깨울 eventfd
+ */
+typedef struct dns_entry_t
+{
+  struct dns_entry_t *next;
+  uint64_t hash;
+  char *hostname, *port;
+  dns_addrs_t addrs;
+  int err, valid;
+  time_t expires;
+  int resolving;
+  struct dns_entry_t *job_next;
+  int *watchers;
+  int nwatchers, watchers_cap;
+} dns_entry_t;
+
+static pthread_mutex_t dns_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t job_ready = PTHREAD_COND_INITIALIZER;
+static pthread_once_t dns_once = PTHREAD_ONCE_INIT;
+static dns_entry_t *table[DNS_BUCKETS];
+static dns_entry_t *jobs, *jobs_tail; // 해석 큐 (FIFO)
+static int nentries;
+
+static void *dns_thread(void *vargp);
+
+/**
+ * dns_start 함수: 해석 스레드들을 만듭니다 (처음 조회할 때 한 번).
+ */
+static void dns_start(void)
+{
+  pthread_t tid;
+  int i;
+
+  for (i = 0; i < DNS_NTHREADS; i++)
+    Pthread_create(&tid, NULL, dns_thread, NULL);
+}
+
+/**
+ * dns_hash 함수: (호스트, 포트)의 FNV-1a 해시를 계산합니다.
+ */
+static uint64_t dns_hash(char *hostname, char *port)
+{
+  uint64_t h = 14695981039346656037ULL;
+  char *s;
+
+  for (s = hostname; *s; s++)
+    h = (h ^ (unsigned char)*s) * 1099511628211ULL;
+  h = (h ^ ':') * 1099511628211ULL;
+  for (s = port; *s; s++)
+    h = (h ^ (unsigned char)*s) * 1099511628211ULL;
+  return h;
+}
+
+/**
+ * dns_sweep 함수: 만료되었고 아무도 기다리지 않는 항목을 해제합니다. dns_lock을 잡은 상태에서 불립니다.
+ */
+static void dns_sweep(time_t now)
+{
+  dns_entry_t *e, **pp;
+  int i;
+
+  for (i = 0; i < DNS_BUCKETS; i++)
+  {
+    for (pp = &table[i]; (e = *pp) != NULL;)
+    {
+      if (e->resolving || e->nwatchers > 0 || (e->valid && now < e->expires))
+      {
+        pp = &e->next;
+        continue;
+      }
+      *pp = e->next;
+      free(e->hostname);
+      free(e->port);
+      free(e->watchers);
+      free(e);
+      nentries--;
+    }
+  }
+}
+
+/**
+ * dns_find 함수: 이름의 항목을 찾고, 없으면 새로 만듭니다. dns_lock을 잡은 상태에서 불립니다.
+ */
+static dns_entry_t *dns_find(char *hostname, char *port, time_t now)
+{
+  uint64_t hash = dns_hash(hostname, port);
+  dns_entry_t *e, **bucket = &table[hash & (DNS_BUCKETS - 1)];
+
+  for (e = *bucket; e; e = e->next)
+    if (e->hash == hash && !strcmp(e->hostname, hostname) && !strcmp(e->port, port))
+      return e;
+  if (nentries >= DNS_MAX_ENTRIES)
+    dns_sweep(now);
+  e = Calloc(1, sizeof(dns_entry_t));
+  e->hash = hash;
+  e->hostname = strdup(hostname);
+  e->port = strdup(port);
+  e->next = *bucket;
+  *bucket = e;
+  nentries++;
+  return e;
+}
+
+/**
+ * dns_enqueue 함수: 항목을 해석 큐에 넣습니다. dns_lock을 잡은 상태에서 불립니다.
+ */
+static void dns_enqueue(dns_entry_t *e)
+{
+  e->resolving = 1;
+  e->job_next = NULL;
+  if (jobs_tail)
+    jobs_tail->job_next = e;
+  else
+    jobs = e;
+  jobs_tail = e;
+  pthread_cond_signal(&job_ready);
+}
+
+/**
+ * dns_interleave 함수: 주소 목록을 첫 주소의 계열과 다른 계열이 번갈아 오도록 다시 놓습니다 (RFC 8305).
+ * 같은 계열 안의 순서는 getaddrinfo가 정한 대로 둡니다.
+ */
+static void dns_interleave(dns_addrs_t *addrs)
+{
+  dns_addrs_t first, other;
+  int i, a = 0, b = 0;
+
+  first.n = other.n = 0;
+  for (i = 0; i < addrs->n; i++)
+  {
+    if (addrs->addr[i].u.sa.sa_family == addrs->addr[0].u.sa.sa_family)
+      first.addr[first.n++] = addrs->addr[i];
+    else
+      other.addr[other.n++] = addrs->addr[i];
+  }
+  for (i = 0; i < addrs->n;)
+  {
+    if (a < first.n)
+      addrs->addr[i++] = first.addr[a++];
+    if (b < other.n)
+      addrs->addr[i++] = other.addr[b++];
+  }
+}
+
+/**
+ * dns_thread 함수: 해석 스레드의 본체입니다. 큐에서 항목을 꺼내 getaddrinfo로 해석하고,
+ * 결과를 항목에 넣은 뒤 기다리던 요청들을 깨웁니다.
+ * 미리 다시 해석하다 실패하면 아직 만료되지 않은 주소를 그대로 둡니다.
+ */
+static void *dns_thread(void *vargp)
+{
+  struct addrinfo hints, *list, *p;
+  dns_entry_t *e;
+  dns_addrs_t addrs;
+  uint64_t one = 1;
+  time_t now;
+  int rc, i;
+
+  Pthread_detach(pthread_self());
+  memset(&hints, 0, sizeof(struct addrinfo));
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = AI_NUMERICSERV | AI_ADDRCONFIG;
+  while (1)
+  {
+    pthread_mutex_lock(&dns_lock);
+    while (!jobs)
+      pthread_cond_wait(&job_ready, &dns_lock);
+    e = jobs;
+    if (!(jobs = e->job_next))
+      jobs_tail = NULL;
+    pthread_mutex_unlock(&dns_lock);
+
+    // 해석 중인 항목은 해제되지 않고 이름도 바뀌지 않으므로 락 밖에서 읽음
+    addrs.n = 0;
+    if ((rc = getaddrinfo(e->hostname, e->port, &hints, &list)) == 0)
+    {
+      for (p = list; p && addrs.n < DNS_MAX_ADDRS; p = p->ai_next)
+      {
+        if (p->ai_addrlen > sizeof(addrs.addr[0].u))
+          continue;
+        memcpy(&addrs.addr[addrs.n].u, p->ai_addr, p->ai_addrlen);
+        addrs.addr[addrs.n++].len = p->ai_addrlen;
+      }
+      freeaddrinfo(list);
+      dns_interleave(&addrs);
+    }
+    else
+      fprintf(stderr, "getaddrinfo failed (%s:%s): %s\n", e->hostname, e->port, gai_strerror(rc));
+
+    now = time(NULL);
+    pthread_mutex_lock(&dns_lock);
+    if (rc == 0 || !e->valid || e->err || now >= e->expires)
+    {
+      e->err = rc;
+      e->addrs = addrs;
+      e->expires = now + (rc == 0 ? DNS_TTL : DNS_NEG_TTL);
+      e->valid = 1;
+    }
+    e->resolving = 0;
+    for (i = 0; i < e->nwatchers; i++)
+      if (write(e->watchers[i], &one, sizeof(one)) < 0 && errno != EAGAIN) // EAGAIN: 깨어날 것이 이미 남아 있음
+        unix_error("eventfd write error");
+    e->nwatchers = 0;
+    pthread_mutex_unlock(&dns_lock);
+  }
+  return NULL;
+}
+
+/**
+ * dns_lookup 함수: 이름의 주소를 블로킹 없이 조회합니다. 캐시에 없거나 만료되었으면 해석을
+ * 시작하고 DNS_PENDING을 반환하며, 해석이 끝나면 efd를 깨웁니다 (그 뒤 다시 조회).
+ * 이벤트 루프는 efd를 epoll이나 io_uring으로 기다립니다.
+ * hostname, port: 원격 서버 (숫자 포트)
+ * out: DNS_OK일 때 주소를 복사할 위치
+ * efd: DNS_PENDING일 때 깨울 eventfd (-1이면 등록하지 않음, 끝까지 기다리지 않으면 dns_unwatch로 빼야 함)
+ */
+enum dns_status dns_lookup(char *hostname, char *port, dns_addrs_t *out, int efd)
+{
+  dns_entry_t *e;
+  time_t now = time(NULL);
+  enum dns_status status;
+  int i;
+
+  pthread_once(&dns_once, dns_start);
+  pthread_mutex_lock(&dns_lock);
+  e = dns_find(hostname, port, now);
+  if (e->valid && now < e->expires)
+  {
+    // 곧 만료될 주소가 쓰이면 요청은 그대로 보내고 백그라운드에서 다시 해석
+    if (!e->err && !e->resolving && e->expires - now <= DNS_REFRESH_AHEAD)
+      dns_enqueue(e);
+    if (!e->err)
+      *out = e->addrs;
+    status = e->err ? DNS_FAIL : DNS_OK;
+    pthread_mutex_unlock(&dns_lock);
+    return status;
+  }
+
+  if (!e->resolving)
+    dns_enqueue(e);
+  for (i = 0; i < e->nwatchers && e->watchers[i] != efd; i++)
+    ;
+  if (efd >= 0 && i == e->nwatchers)
+  {
+    if (e->nwatchers == e->watchers_cap)
+    {
+      e->watchers_cap = e->watchers_cap ? e->watchers_cap * 2 : 8;
+      e->watchers = Realloc(e->watchers, e->watchers_cap * sizeof(int));
+    }
+    e->watchers[e->nwatchers++] = efd;
+  }
+  pthread_mutex_unlock(&dns_lock);
+  return DNS_PENDING;
+}
+
+/**
+ * dns_unwatch 함수: 해석이 끝나기 전에 떠나는 요청의 eventfd를 뺍니다.
+ * 반환한 뒤에는 해석 스레드가 efd에 쓰지 않으므로 닫아도 됩니다.
+ */
+void dns_unwatch(char *hostname, char *port, int efd)
+{
+  uint64_t hash = dns_hash(hostname, port);
+  dns_entry_t *e;
+  int i;
+
+  pthread_mutex_lock(&dns_lock);
+  for (e = table[hash & (DNS_BUCKETS - 1)]; e; e = e->next)
+  {
+    if (e->hash != hash || strcmp(e->hostname, hostname) || strcmp(e->port, port))
+      continue;
+    for (i = 0; i < e->nwatchers; i++)
+    {
+      if (e->watchers[i] == efd)
+      {
+        e->watchers[i] = e->watchers[--e->nwatchers];
+        break;
+      }
+    }
+    break;
+  }
+  pthread_mutex_unlock(&dns_lock);
+}
+
+/**
+ * dns_resolve 함수: 이름의 주소를 얻을 때까지 기다립니다. 스레드 모드에서는 poll로 스레드를 재우고,
+ * 코루틴 모드에서는 rio_wait로 양보하므로 해석이 느려도 스케줄러를 막지 않습니다.
+ * 반환: 0, 해석할 수 없으면 -1
+ */
+int dns_resolve(char *hostname, char *port, dns_addrs_t *out)
+{
+  enum dns_status status;
+  uint64_t v;
+  int efd;
+
+  if ((status = dns_lookup(hostname, port, out, -1)) != DNS_PENDING)
+    return status == DNS_OK ? 0 : -1;
+  if ((efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0)
+    return -1;
+  while ((status = dns_lookup(hostname, port, out, efd)) == DNS_PENDING)
+  {
+    rio_wait(efd, POLLIN);
+    if (read(efd, &v, sizeof(v)) < 0 && errno != EAGAIN)
+      break;
+  }
+  dns_unwatch(hostname, port, efd);
+  close(efd);
+  return status == DNS_OK ? 0 : -1;
+}
+
+/**
+ * dns_now 함수: 단조 시계의 현재 시각을 밀리초로 반환합니다.
+ */
+static long dns_now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000L + ts.tv_nsec / 1000000;
+}
+
+/**
+ * dns_connect 함수: 주소 후보들에 RFC 8305 (Happy Eyeballs) 방식으로 연결합니다.
+ * CONNECT_ATTEMPT_DELAY마다 다음 후보의 논블로킹 connect를 앞선 시도와 함께 진행하고, 가장 먼저
+ * 연결된 소켓을 쓰며 나머지는 닫습니다. 시도가 실패하면 다음 후보를 바로 시작하고,
+ * CONNECT_ATTEMPT_TIMEOUT 안에 연결되지 않은 시도는 버립니다.
+ * 진행 중인 시도들을 임시 epoll에 모아 그 fd 하나를 rio_wait_timeout으로 기다리므로
+ * 코루틴 모드에서는 스케줄러에 양보합니다.
+ * 반환: 연결된 소켓 (대기 훅이 없으면 블로킹으로 되돌림), 모든 후보가 실패하면 -1
+ */
+static int dns_connect(dns_addrs_t *addrs)
+{
+  struct epoll_event ev, events[DNS_MAX_ADDRS];
+  int fds[DNS_MAX_ADDRS];
+  long deadline[DNS_MAX_ADDRS], now, next_start, wait;
+  int epfd, i, k, n, next = 0, active = 0, winner = -1, err;
+  socklen_t errlen;
+
+  if ((epfd = epoll_create1(EPOLL_CLOEXEC)) < 0)
+  {
+    // 함께 기다릴 수 없으면 후보를 차례로 시도
+    for (i = 0; i < addrs->n; i++)
+      if ((winner = connect_clientfd(&addrs->addr[i].u.sa, addrs->addr[i].len)) >= 0)
+        break;
+    return winner;
+  }
+
+  now = next_start = dns_now();
+  while (winner < 0 && (next < addrs->n || active > 0))
+  {
+    // 시작할 때가 된 후보의 연결 시작 (실패하면 다음 후보를 바로 시작)
+    if (next < addrs->n && now >= next_start)
+    {
+      i = next++;
+      next_start = now + CONNECT_ATTEMPT_DELAY;
+      fds[i] = socket(addrs->addr[i].u.sa.sa_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+      if (fds[i] < 0)
+      {
+        next_start = now;
+        continue;
+      }
+      if (connect(fds[i], &addrs->addr[i].u.sa, addrs->addr[i].len) == 0)
+      {
+        winner = fds[i];
+        fds[i] = -1;
+        break;
+      }
+      ev.events = EPOLLOUT;
+      ev.data.u32 = i;
+      if (errno != EINPROGRESS || epoll_ctl(epfd, EPOLL_CTL_ADD, fds[i], &ev) < 0)
+      {
+        close(fds[i]);
+        fds[i] = -1;
+        next_start = now;
+        continue;
+      }
+      deadline[i] = now + CONNECT_ATTEMPT_TIMEOUT;
+      active++;
+    }
+    if (active == 0)
+    {
+      next_start = now;
+      continue;
+    }
+
+    // 다음 후보를 시작할 때나 가장 이른 시도의 기한까지 기다림
+    wait = next < addrs->n ? next_start - now : CONNECT_ATTEMPT_TIMEOUT;
+    for (i = 0; i < next; i++)
+      if (fds[i] >= 0 && deadline[i] - now < wait)
+        wait = deadline[i] - now;
+    rio_wait_timeout(epfd, POLLIN, wait > 0 ? wait : 0);
+    n = epoll_wait(epfd, events, DNS_MAX_ADDRS, 0);
+    now = dns_now();
+    for (k = 0; k < n && winner < 0; k++)
+    {
+      i = events[k].data.u32;
+      errlen = sizeof(err);
+      if (getsockopt(fds[i], SOL_SOCKET, SO_ERROR, &err, &errlen) == 0 && !err)
+        winner = fds[i];
+      else
+        close(fds[i]);
+      fds[i] = -1;
+      active--;
+      next_start = now;
+    }
+    for (i = 0; i < next && winner < 0; i++)
+    {
+      if (fds[i] >= 0 && deadline[i] <= now)
+      {
+        close(fds[i]); // 응답하지 않는 주소
+        fds[i] = -1;
+        active--;
+        next_start = now;
+      }
+    }
+  }
+
+  // 진 시도들은 닫음 (epoll에서도 빠짐)
+  for (i = 0; i < next; i++)
+    if (fds[i] >= 0)
+      close(fds[i]);
+  close(epfd);
+  if (winner >= 0 && !rio_wait_hook)
+    fcntl(winner, F_SETFL, fcntl(winner, F_GETFL) & ~O_NONBLOCK);
+  return winner;
+}
+
+/**
+ * dns_open_clientfd 함수: open_clientfd와 같지만 주소를 캐시에서 얻고, 주소 후보들에
+ * 시차를 두고 함께 연결하여 먼저 연결된 것을 씁니다 (dns_connect).
+ * 반환: 연결된 소켓, 이름을 해석할 수 없으면 -2, 모든 주소에 연결할 수 없으면 -1
+ */
+int dns_open_clientfd(char *hostname, char *port)
+{
+  dns_addrs_t addrs;
+
+  if (dns_resolve(hostname, port, &addrs) < 0)
+    return -2;
+  return dns_connect(&addrs);
+}
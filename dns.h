@@ -0,0 +1,53 @@
+#ifndef __DNS_H__
+#define __DNS_H__
+
+#include "csapp.h"
+
+// 원격 서버 주소 캐시 상수 정의
+#define DNS_BUCKETS       64   // 주소 캐시의 해시 버킷 수 (2의 거듭제곱)
+#define DNS_MAX_ENTRIES   1024 // 이만큼 차면 만료된 항목을 정리
+#define DNS_MAX_ADDRS     8    // 항목 하나에 기억할 주소 수
+#define DNS_TTL           60   // 해석한 주소의 수명 (초, getaddrinfo는 레코드의 TTL을 알려 주지 않음)
+#define DNS_NEG_TTL       5    // 해석에 실패한 이름을 기억하는 시간 (초)
+#define DNS_REFRESH_AHEAD 10   // 만료까지 이만큼 남은 항목이 쓰이면 백그라운드에서 미리 다시 해석 (초)
+#define DNS_NTHREADS      4    // 해석 스레드 수
+
+// 원격 서버 연결 상수 정의
+#define CONNECT_ATTEMPT_DELAY   250  // 다음 주소 후보의 연결을 함께 시작하기까지의 간격 (밀리초, RFC 8305)
+#define CONNECT_ATTEMPT_TIMEOUT 2000 // 주소 후보 하나의 연결 제한 시간 (밀리초)
+
+/* dns_lookup 반환 값 */
+enum dns_status
+{
+  DNS_OK,     // 주소를 복사함
+  DNS_FAIL,   // 해석할 수 없는 이름 (DNS_NEG_TTL 동안 다시 묻지 않음)
+  DNS_PENDING // 해석 중 (끝나면 등록한 eventfd를 깨움)
+};
+
+/**
+ * dns_addrs_t 구조체: 원격 서버 하나의 주소 목록입니다. getaddrinfo가 정한 순서를 따르되
+ * 주소 계열(IPv6, IPv4)을 번갈아 놓아 연결을 시도할 순서로 씁니다 (RFC 8305).
+ * 캐시에서 복사해 쓰므로 호출자가 해제할 것이 없습니다.
+ */
+typedef struct dns_addrs_t
+{
+  int n;
+  struct
+  {
+    socklen_t len;
+    union
+    {
+      struct sockaddr sa;
+      struct sockaddr_in in;
+      struct sockaddr_in6 in6;
+    } u;
+  } addr[DNS_MAX_ADDRS];
+} dns_addrs_t;
+
+// 원격 서버 주소 캐시 함수 선언
+enum dns_status dns_lookup(char *hostname, char *port, dns_addrs_t *out, int efd);
+void dns_unwatch(char *hostname, char *port, int efd);
+int dns_resolve(char *hostname, char *port, dns_addrs_t *out);
+int dns_open_clientfd(char *hostname, char *port);
+
+#endif /* __DNS_H__ */
@@ -0,0 +1,162 @@
+#include "epoch.h"
+
+/*
+ * epoch.c - 에포크 기반 메모리 회수
+ *
+ * 락 없이 공유 자료구조를 읽는 스레드는 epoch_enter와 epoch_exit 사이에서만 포인터를 따라갑니다.
+ * 자료구조에서 떼어낸 메모리는 바로 해제하지 않고 epoch_retire로 넘기며, 떼어낸 시점에
+ * 이미 읽고 있던 스레드가 모두 빠져나간 뒤에 해제됩니다.
+ *
+ * 전역 에포크는 retire할 때마다 1씩 증가합니다. 읽는 스레드는 들어올 때 본 전역 에포크를
+ * 자기 기록에 적어 두고, retire된 메모리는 그때의 새 에포크 t를 받습니다. 활성 기록들의
+ * 에포크가 모두 t 이상이면 그 메모리를 볼 수 있는 스레드는 없습니다.
+ */
+
+/**
+ * epoch_rec_t 구조체: 스레드 하나의 에포크 기록입니다. 스레드가 끝나면 다른 스레드가 재사용합니다.
+ * epoch: 읽는 중이면 들어올 때 본 전역 에포크, 아니면 0
+ * in_use: 스레드가 이 기록을 쓰고 있으면 1
+ */
+typedef struct epoch_rec_t
+{
+  unsigned long epoch;
+  int in_use;
+  struct epoch_rec_t *next;
+} __attribute__((aligned(64))) epoch_rec_t;
+
+/**
+ * retired_t 구조체: 해제를 기다리는 메모리입니다.
+ */
+typedef struct retired_t
+{
+  void *ptr;
+  void (*free_fn)(void *);
+  unsigned long epoch;
+  struct retired_t *next;
+} retired_t;
+
+static unsigned long global_epoch = 1;
+static epoch_rec_t *epoch_recs;            // 모든 기록 (앞에만 추가되고 빠지지 않음)
+static __thread epoch_rec_t *my_rec;       // 현재 스레드의 기록
+static pthread_key_t epoch_key;            // 스레드 종료 시 기록을 돌려놓기 위한 키
+static pthread_once_t epoch_once = PTHREAD_ONCE_INIT;
+
+static pthread_mutex_t limbo_lock = PTHREAD_MUTEX_INITIALIZER;
+static retired_t *limbo;                   // 해제를 기다리는 메모리 목록
+static int nlimbo;
+
+/**
+ * epoch_release_rec 함수: 스레드가 끝날 때 기록을 재사용할 수 있게 돌려놓습니다.
+ */
+static void epoch_release_rec(void *vrec)
+{
+  epoch_rec_t *rec = vrec;
+
+  __atomic_store_n(&rec->epoch, 0, __ATOMIC_RELEASE);
+  __atomic_store_n(&rec->in_use, 0, __ATOMIC_RELEASE);
+}
+
+static void epoch_key_init(void)
+{
+  pthread_key_create(&epoch_key, epoch_release_rec);
+}
+
+/**
+ * epoch_register 함수: 현재 스레드의 기록을 정합니다.
+ * 끝난 스레드의 기록이 있으면 재사용하고, 없으면 새로 만들어 목록 앞에 붙입니다.
+ */
+static epoch_rec_t *epoch_register(void)
+{
+  epoch_rec_t *rec;
+
+  pthread_once(&epoch_once, epoch_key_init);
+  for (rec = __atomic_load_n(&epoch_recs, __ATOMIC_ACQUIRE); rec; rec = rec->next)
+    if (!__atomic_load_n(&rec->in_use, __ATOMIC_RELAXED) &&
+        !__atomic_exchange_n(&rec->in_use, 1, __ATOMIC_ACQUIRE))
+      break;
+
+  if (!rec)
+  {
+    if (posix_memalign((void **)&rec, 64, sizeof(epoch_rec_t)) != 0)
+      unix_error("posix_memalign error");
+    rec->epoch = 0;
+    rec->in_use = 1;
+    rec->next = __atomic_load_n(&epoch_recs, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&epoch_recs, &rec->next, rec, 0,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+      ;
+  }
+  pthread_setspecific(epoch_key, rec);
+  return rec;
+}
+
+/**
+ * epoch_enter 함수: 락 없이 읽는 구간을 시작합니다. 중첩해서 부르면 안 됩니다.
+ */
+void epoch_enter(void)
+{
+  if (!my_rec)
+    my_rec = epoch_register();
+  __atomic_store_n(&my_rec->epoch, __atomic_load_n(&global_epoch, __ATOMIC_ACQUIRE), __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST); // 이후의 읽기보다 에포크 공표가 먼저 보이도록
+}
+
+/**
+ * epoch_exit 함수: 락 없이 읽는 구간을 끝냅니다. 이후로는 구간에서 얻은 포인터를 쓰면 안 됩니다.
+ */
+void epoch_exit(void)
+{
+  __atomic_store_n(&my_rec->epoch, 0, __ATOMIC_RELEASE);
+}
+
+/**
+ * epoch_reclaim 함수: 읽는 스레드가 더 이상 볼 수 없는 메모리를 해제합니다.
+ * limbo_lock을 잡은 상태에서 호출합니다.
+ */
+static void epoch_reclaim(void)
+{
+  unsigned long min = ~0UL, e;
+  epoch_rec_t *rec;
+  retired_t **pp, *r;
+
+  __atomic_thread_fence(__ATOMIC_SEQ_CST); // 떼어낸 뒤에 읽는 스레드의 에포크를 확인
+  for (rec = __atomic_load_n(&epoch_recs, __ATOMIC_ACQUIRE); rec; rec = rec->next)
+    if ((e = __atomic_load_n(&rec->epoch, __ATOMIC_ACQUIRE)) && e < min)
+      min = e;
+
+  for (pp = &limbo; (r = *pp);)
+  {
+    if (r->epoch <= min)
+    {
+      *pp = r->next;
+      r->free_fn(r->ptr);
+      free(r);
+      nlimbo--;
+    }
+    else
+      pp = &r->next;
+  }
+}
+
+/**
+ * epoch_retire 함수: 공유 자료구조에서 떼어낸 메모리의 해제를 미룹니다.
+ * 떼어낸 뒤에 호출해야 하며, 떼어내기 전에 읽기 시작한 스레드가 모두 끝나면 free_fn으로 해제됩니다.
+ *
+ * ptr: 해제할 메모리
+ * free_fn: 해제 함수
+ */
+void epoch_retire(void *ptr, void (*free_fn)(void *))
+{
+  retired_t *r = Malloc(sizeof(retired_t));
+
+  r->ptr = ptr;
+  r->free_fn = free_fn;
+  r->epoch = __atomic_add_fetch(&global_epoch, 1, __ATOMIC_SEQ_CST);
+
+  pthread_mutex_lock(&limbo_lock);
+  r->next = limbo;
+  limbo = r;
+  if (++nlimbo >= EPOCH_RECLAIM_BATCH)
+    epoch_reclaim();
+  pthread_mutex_unlock(&limbo_lock);
+}
@@ -0,0 +1,13 @@
+#ifndef __EPOCH_H__
+#define __EPOCH_H__
+
+#include "csapp.h"
+
+#define EPOCH_RECLAIM_BATCH 8 // 이만큼 쌓이면 해제할 수 있는 메모리를 찾아 해제
+
+// 에포크 기반 메모리 회수 함수 선언
+void epoch_enter(void);
+void epoch_exit(void);
+void epoch_retire(void *ptr, void (*free_fn)(void *));
+
+#endif /* __EPOCH_H__ */
@@ -0,0 +1,976 @@
+#define _GNU_SOURCE
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <stdint.h>
+#include <sched.h>
+#include <linux/filter.h>
+#include "proxy.h"
+
+/*
+ * event.c - 논블로킹 edge-triggered epoll 기반 이벤트 루프 모드
+ *
+ * 각 연결은 작은 상태 기계(요청 읽기 → 원격 서버 연결 → 요청 전송 → 응답 중계)로
+ * 표현되고, 코어당 하나의 이벤트 루프 스레드가 여러 연결을 다중화합니다.
+ * 연결마다 스레드 스택 대신 conn_t 하나와 버퍼 몇 개만 사용합니다.
+ *
+ * shard 모드에서는 각 루프가 SO_REUSEPORT로 자기만의 리스닝 소켓과 캐시 파티션을 가지므로
+ * 루프 사이에 공유되는 상태가 없습니다 (shared-nothing).
+ *
+ * 원격 서버 주소 후보마다 CONNECT_ATTEMPT_TIMEOUT 안에 연결되지 않으면 다음 후보로 넘어갑니다.
+ * 연결 중인 연결은 루프의 타이머 목록에 두고 EV_TIMER_TICK마다 기한을 확인합니다 (coro.c와 같은 방식).
+ */
+
+#define EV_MAXEVENTS  256     // epoll_wait 한 번에 처리할 최대 이벤트 수
+#define RELAY_BUFSIZE 16384   // 서버 → 클라이언트 중계 버퍼 크기
+#define EV_SERVER     0x1     // epoll 데이터 포인터에 붙이는 "서버 소켓" 태그
+#define EV_FLIGHT     0x2     // epoll 데이터 포인터에 붙이는 "함께 기다리는 요청/주소 해석의 eventfd" 태그
+#define EV_TIMER_TICK 100     // 연결 시도의 기한을 확인하는 간격 (밀리초)
+
+/* 연결 상태 */
+enum conn_state
+{
+  C_READ_REQ,     // 클라이언트 요청 헤더를 읽는 중
+  C_RESOLVE,      // 원격 서버 주소 해석을 기다리는 중 (dns.c)
+  C_CONNECT,      // 원격 서버에 논블로킹 connect 진행 중
+  C_SEND_REQ,     // 원격 서버에 요청을 전송하는 중
+  C_RELAY,        // 원격 서버의 응답을 클라이언트로 중계하는 중
+  C_WRITE_CLIENT, // 버퍼에 준비된 응답(캐시 적중, 오류)을 클라이언트에 쓰는 중
+  C_FOLLOW,       // 같은 경로를 받아 오는 리더의 응답을 클라이언트로 옮기는 중
+  C_DONE          // 종료됨, 이벤트 배치 처리 후 해제 대기
+};
+
+/**
+ * conn_t 구조체: 이벤트 루프가 관리하는 프록시 연결 하나의 상태입니다.
+ * buf: 요청 읽기 → 요청/응답 송신 → 응답 헤더 수집 순서로 재사용되는 버퍼
+ * relay, hdr_sent: 응답 중계 버퍼 (연결 시점에 할당)와 클라이언트에 보낼 헤더로 바꿨는지 (relay_header)
+ * scan: 응답 헤더/본문 스캔 상태 (캐시할 본문 사본 포함)
+ * path: 캐시 키 (GET이 아니면 NULL), reqflags: 요청 헤더 플래그
+ * stale: 재검증 중인 캐시 객체 (참조를 가진 상태, 응답 헤더를 다 받을 때까지 클라이언트에 쓰지 않음)
+ * flight, leader: 함께 기다리는 원격 요청과 이 연결이 그 리더인지 (flight.c)
+ * efd, fpos: 팔로워나 주소 해석을 기다리는 연결의 eventfd와 팔로워가 클라이언트에 보낸 길이
+ * addrs, addr: 원격 서버 주소 후보와 연결을 시도할 후보의 인덱스
+ * deadline, timer_prev, timer_next: 연결 시도의 기한 (단조 시계, 밀리초, 0이면 목록에 없음)과 루프 타이머 목록의 이웃
+ * resolving: 주소 해석을 기다리며 efd를 dns_lookup에 등록했으면 1
+ * host, port: 요청 URI의 원격 서버 (연결 풀의 키, 리더가 거절한 팔로워도 사용)
+ * reused: 원격 서버 연결을 풀에서 꺼냈으면 1 (응답 없이 닫히면 새 연결로 다시 보냄)
+ */
+typedef struct conn_t
+{
+  enum conn_state state;
+  int clientfd, serverfd;
+  char *buf;
+  size_t len, pos, cap;
+  dns_addrs_t addrs;
+  int addr;
+  long deadline;
+  struct conn_t *timer_prev, *timer_next;
+  char *path;
+  int reqflags;
+  web_object_t *stale;
+  flight_t *flight;
+  int leader;
+  int efd;
+  size_t fpos;
+  int resolving;
+  char *host, *port;
+  int reused;
+  char *relay;
+  size_t rlen, rpos;
+  int hdr_sent;
+  int server_eof;
+  resp_scan_t scan;
+  struct conn_t *next_closed;
+} conn_t;
+
+/**
+ * evloop_t 구조체: 이벤트 루프 스레드 하나의 상태입니다.
+ * cache: 이 루프가 사용하는 캐시 파티션 (epoll 모드는 공유, shard 모드는 전용)
+ * cpu: 고정할 CPU 번호 (-1이면 고정하지 않음)
+ * closed: 이번 이벤트 배치에서 종료된 연결 목록 (배치가 끝난 뒤 해제)
+ * timers: 원격 서버에 연결 중인 연결 목록, next_sweep: 다음에 기한을 확인할 시각
+ */
+typedef struct evloop_t
+{
+  int epfd;
+  int listenfd;
+  cache_t *cache;
+  int cpu;
+  conn_t *closed;
+  conn_t *timers;
+  long next_sweep;
+} evloop_t;
+
+static void conn_run(evloop_t *loop, conn_t *c, int from_server);
+static void conn_fetch(evloop_t *loop, conn_t *c, int pooled);
+
+/**
+ * ev_now 함수: 단조 시계의 현재 시각을 밀리초로 반환합니다.
+ */
+static long ev_now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000L + ts.tv_nsec / 1000000;
+}
+
+/**
+ * conn_timer_add 함수: 연결 시도의 기한을 정하고 연결을 루프의 타이머 목록에 넣습니다.
+ */
+static void conn_timer_add(evloop_t *loop, conn_t *c)
+{
+  c->deadline = ev_now() + CONNECT_ATTEMPT_TIMEOUT;
+  c->timer_prev = NULL;
+  c->timer_next = loop->timers;
+  if (loop->timers)
+    loop->timers->timer_prev = c;
+  loop->timers = c;
+}
+
+/**
+ * conn_timer_remove 함수: 연결을 루프의 타이머 목록에서 뺍니다 (목록에 없으면 아무것도 하지 않음).
+ */
+static void conn_timer_remove(evloop_t *loop, conn_t *c)
+{
+  if (!c->deadline)
+    return;
+  if (c->timer_prev)
+    c->timer_prev->timer_next = c->timer_next;
+  else
+    loop->timers = c->timer_next;
+  if (c->timer_next)
+    c->timer_next->timer_prev = c->timer_prev;
+  c->deadline = 0;
+}
+
+/**
+ * conn_release_server 함수: 원격 서버 연결을 응답의 끝까지 정확히 읽었고 원격 서버가 유지하면
+ * epoll에서 뺀 뒤 풀에 돌려주고 (다른 루프가 꺼내 쓸 수 있음), 아니면 닫습니다.
+ */
+static void conn_release_server(evloop_t *loop, conn_t *c)
+{
+  resp_scan_t *sc = &c->scan;
+
+  if (c->serverfd < 0)
+    return;
+  if (scan_done(sc) && sc->body_seen == sc->content_length && sc->hdr_len < sc->hdr_cap - 1 &&
+      upstream_keepalive(sc->hdr) && epoll_ctl(loop->epfd, EPOLL_CTL_DEL, c->serverfd, NULL) == 0)
+    upstream_put(c->serverfd, c->host, c->port);
+  else
+    close(c->serverfd); // epoll에서도 빠짐
+  c->serverfd = -1;
+}
+
+/**
+ * conn_leave_flight 함수: 함께 기다리던 원격 요청에서 빠집니다. 리더면 요청을 끝냅니다.
+ * 리더가 더 이상 깨우지 않도록 eventfd를 등록에서 뺀 뒤에 닫습니다.
+ */
+static void conn_leave_flight(conn_t *c)
+{
+  if (!c->flight)
+    return;
+  if (c->leader)
+    flight_end(c->flight);
+  flight_leave(c->flight, c->efd);
+  if (c->efd >= 0)
+    close(c->efd); // epoll에서도 빠짐
+  c->flight = NULL;
+  c->leader = 0;
+  c->efd = -1;
+}
+
+/**
+ * conn_leave_dns 함수: 기다리던 주소 해석에서 빠집니다.
+ * 해석 스레드가 더 이상 깨우지 않도록 eventfd를 등록에서 뺀 뒤에 닫습니다.
+ */
+static void conn_leave_dns(conn_t *c)
+{
+  if (!c->resolving)
+    return;
+  dns_unwatch(origin_host(c->host), c->port, c->efd);
+  close(c->efd); // epoll에서도 빠짐
+  c->efd = -1;
+  c->resolving = 0;
+}
+
+/**
+ * conn_close 함수: 연결의 소켓을 닫고 해제 대기 목록에 넣습니다.
+ * 같은 배치 안에 이 연결의 이벤트가 더 남아 있을 수 있으므로 메모리는 나중에 해제합니다.
+ */
+static void conn_close(evloop_t *loop, conn_t *c)
+{
+  if (c->state == C_DONE)
+    return;
+  c->state = C_DONE;
+  conn_timer_remove(loop, c);
+  conn_leave_dns(c);
+  conn_leave_flight(c);
+  close(c->clientfd);
+  conn_release_server(loop, c);
+  c->next_closed = loop->closed;
+  loop->closed = c;
+}
+
+/**
+ * conn_free 함수: 종료된 연결의 메모리를 해제합니다.
+ */
+static void conn_free(conn_t *c)
+{
+  free(c->buf);
+  free(c->path);
+  free(c->relay);
+  free(c->host);
+  free(c->port);
+  scan_free(&c->scan);
+  if (c->stale)
+    release_cache(c->stale);
+  free(c);
+}
+
+/**
+ * conn_reply 함수: 준비된 응답을 연결의 버퍼로 삼고 클라이언트 쓰기 상태로 전환합니다.
+ * data: Malloc으로 할당된 응답 바이트 (소유권이 연결로 넘어감), n: 길이
+ */
+static void conn_reply(evloop_t *loop, conn_t *c, char *data, size_t n)
+{
+  free(c->buf);
+  c->buf = data;
+  c->cap = c->len = n;
+  c->pos = 0;
+  c->state = C_WRITE_CLIENT;
+  conn_run(loop, c, 0);
+}
+
+/**
+ * conn_error 함수: 클라이언트에게 HTTP 오류 응답을 보내고 연결을 종료합니다.
+ */
+static void conn_error(evloop_t *loop, conn_t *c, char *cause, char *errnum, char *shortmsg, char *longmsg)
+{
+  char *buf = Malloc(MAXLINE + MAXBUF);
+  int n = format_clienterror(buf, cause, errnum, shortmsg, longmsg);
+  conn_reply(loop, c, buf, n);
+}
+
+/**
+ * conn_serve_stale 함수: 원격 서버 대신 신선하지 않은 캐시 객체로 응답합니다 (stale-if-error).
+ */
+static void conn_serve_stale(evloop_t *loop, conn_t *c)
+{
+  size_t len;
+  char *out = dup_cache_response(c->stale, &len, 0);
+
+  release_cache(c->stale);
+  c->stale = NULL;
+  conn_release_server(loop, c);
+  if (out)
+    conn_reply(loop, c, out, len);
+  else
+    conn_error(loop, c, "", "502", "Bad Gateway", "📍 Failed to read the cached object");
+}
+
+/**
+ * conn_bad_gateway 함수: 원격 서버에 연결할 수 없을 때, 보내도 되는 캐시 객체가 있으면
+ * 그것으로, 없으면 502로 응답합니다.
+ */
+static void conn_bad_gateway(evloop_t *loop, conn_t *c, char *cause)
+{
+  if (c->stale && http_serve_stale(c->stale, c->reqflags, 1))
+    conn_serve_stale(loop, c);
+  else
+    conn_error(loop, c, cause, "502", "Bad Gateway", "📍 Failed to establish connection with the end server");
+}
+
+/**
+ * conn_retry 함수: 풀에서 꺼낸 연결을 원격 서버가 그 사이 닫아 응답을 하나도 받지 못했으면
+ * 같은 요청을 새 연결로 다시 보냅니다 (GET, HEAD는 다시 보내도 안전).
+ * 응답 바이트가 없었으므로 버퍼의 요청은 그대로 남아 있습니다.
+ */
+static void conn_retry(evloop_t *loop, conn_t *c)
+{
+  close(c->serverfd); // epoll에서도 빠짐
+  c->serverfd = -1;
+  free(c->relay);
+  c->relay = NULL;
+  c->rlen = c->rpos = 0;
+  c->pos = 0;
+  conn_fetch(loop, c, 0);
+}
+
+/**
+ * conn_connect 함수: 남은 주소 후보에 대해 논블로킹 connect를 시작합니다.
+ * 모든 후보가 실패하면 conn_bad_gateway로 응답합니다.
+ */
+static void conn_connect(evloop_t *loop, conn_t *c)
+{
+  struct epoll_event ev;
+
+  for (; c->addr < c->addrs.n; c->addr++)
+  {
+    struct sockaddr *sa = &c->addrs.addr[c->addr].u.sa;
+    c->serverfd = socket(sa->sa_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (c->serverfd < 0)
+      continue;
+    if (connect(c->serverfd, sa, c->addrs.addr[c->addr].len) == 0 || errno == EINPROGRESS)
+    {
+      ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+      ev.data.u64 = (uintptr_t)c | EV_SERVER;
+      if (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, c->serverfd, &ev) == 0)
+      {
+        c->state = C_CONNECT;
+        conn_timer_add(loop, c);
+        return;
+      }
+    }
+    close(c->serverfd);
+    c->serverfd = -1;
+  }
+  conn_bad_gateway(loop, c, "");
+}
+
+/**
+ * conn_resolve 함수: 원격 서버 주소를 캐시에서 얻어 연결을 시작합니다 (dns.c).
+ * 캐시에 없으면 eventfd를 epoll과 dns_lookup에 등록하고 해석이 끝나 깨어날 때 다시 불립니다.
+ * 해석할 수 없는 이름이면 conn_bad_gateway로 응답합니다.
+ */
+static void conn_resolve(evloop_t *loop, conn_t *c)
+{
+  enum dns_status status;
+  struct epoll_event ev;
+
+  while ((status = dns_lookup(origin_host(c->host), c->port, &c->addrs, c->efd)) == DNS_PENDING)
+  {
+    if (c->resolving)
+    {
+      c->state = C_RESOLVE;
+      return;
+    }
+    if ((c->efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0)
+      break;
+    ev.events = EPOLLIN | EPOLLET;
+    ev.data.u64 = (uintptr_t)c | EV_FLIGHT;
+    if (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, c->efd, &ev) < 0)
+    {
+      close(c->efd);
+      c->efd = -1;
+      break;
+    }
+    c->resolving = 1; // 등록한 뒤 다시 조회 (그 사이 해석이 끝났을 수 있음)
+  }
+  conn_leave_dns(c);
+  if (status != DNS_OK)
+  {
+    conn_bad_gateway(loop, c, c->host);
+    return;
+  }
+  c->addr = 0;
+  conn_connect(loop, c);
+}
+
+/**
+ * conn_follow 함수: 리더가 공개한 응답 바이트를 클라이언트에 쓸 수 있는 만큼 씁니다.
+ * 다 보냈으면 eventfd를 비우고 다음 공개를 기다립니다. 리더가 거절하면 직접 원격 서버에 연결합니다.
+ */
+static void conn_follow(evloop_t *loop, conn_t *c)
+{
+  enum flight_state state;
+  size_t len, avail;
+  char *data;
+  uint64_t count;
+  ssize_t n;
+
+  while (1)
+  {
+    state = flight_poll(c->flight, &len);
+    if ((avail = follow_data(c->flight, len, c->fpos, &data)) > 0)
+    {
+      n = write(c->clientfd, data, avail);
+      if (n > 0)
+      {
+        c->fpos += n;
+        continue;
+      }
+      if (errno != EAGAIN && errno != EINTR)
+        conn_close(loop, c);
+      return;
+    }
+    if (state == FLIGHT_DECLINED)
+    {
+      conn_leave_flight(c);
+      conn_fetch(loop, c, 1);
+      return;
+    }
+    if (state != FLIGHT_PENDING && state != FLIGHT_STREAM)
+    {
+      conn_close(loop, c); // 완료 또는 실패
+      return;
+    }
+    if (read(c->efd, &count, sizeof(count)) < 0)
+      return; // 다음 공개까지 대기 (edge-triggered)
+  }
+}
+
+/**
+ * conn_follow_start 함수: 같은 경로를 받아 오는 리더에 팔로워로 붙습니다.
+ * eventfd를 epoll에 등록하고 flight_watch로 깨우기를 받습니다.
+ * 반환: 붙었으면 1, eventfd를 만들 수 없으면 요청에서 빠지고 0 (호출자가 직접 연결)
+ */
+static int conn_follow_start(evloop_t *loop, conn_t *c)
+{
+  struct epoll_event ev;
+
+  if ((c->efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) >= 0)
+  {
+    ev.events = EPOLLIN | EPOLLET;
+    ev.data.u64 = (uintptr_t)c | EV_FLIGHT;
+    if (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, c->efd, &ev) == 0)
+    {
+      c->state = C_FOLLOW;
+      flight_watch(c->flight, c->efd);
+      conn_follow(loop, c);
+      return 1;
+    }
+  }
+  conn_leave_flight(c);
+  return 0;
+}
+
+/**
+ * conn_request 함수: 모인 요청 헤더를 해석하여 신선한 캐시 적중이면 바로 응답하고,
+ * 아니면 원격 서버로 보낼 요청(신선하지 않은 객체는 조건부 요청)을 버퍼에 만들고 연결을 시작합니다.
+ * 같은 경로를 이미 받아 오는 연결이 있으면 원격 서버 대신 그 응답을 함께 받습니다.
+ */
+static void conn_request(evloop_t *loop, conn_t *c)
+{
+  char method[MAXLINE], path[MAXLINE], hostname[MAXLINE], port[MAXLINE], cond[MAXLINE];
+  char *out = Malloc(UPSTREAM_BUFSIZE);
+  size_t len;
+
+  // 원격 서버로 보낼 요청(요청 라인 + 수정된 헤더)을 새 버퍼에 구성
+  int n = build_request(c->buf, out, method, hostname, port, path, &c->reqflags);
+  if (n < 0)
+  {
+    free(out);
+    if (n == REQ_NOT_IMPL)
+      conn_error(loop, c, method, "501", "Not implemented", "Tiny does not implement this method");
+    else
+      conn_error(loop, c, "", "400", "Bad Request", "Tiny could not parse the request");
+    return;
+  }
+
+  // 캐시된 객체가 신선하거나 재검증 중에 보내도 되면 헤더와 본문의 사본을 응답으로 전송하고
+  // (재검증을 맡았으면 백그라운드에서 재검증), 아니면 조건부 요청으로 재검증
+  int get = !strcasecmp(method, "GET"); // HEAD 응답은 본문이 없으므로 캐시를 쓰지 않음
+  web_object_t *cached_object = get ? lookup_cache(loop->cache, path) : NULL;
+  if (cached_object)
+  {
+    int claim = 0;
+    if (http_fresh(cached_object, c->reqflags) ||
+        (http_serve_stale(cached_object, c->reqflags, 0) && (claim = http_claim_refresh(cached_object)) >= 0))
+    {
+      char *reply = dup_cache_response(cached_object, &len, 0);
+      if (reply)
+      {
+        if (claim)
+          refresh_async(loop->cache, cached_object, out, n, hostname, port, c->reqflags);
+        else
+          release_cache(cached_object);
+        free(out);
+        conn_reply(loop, c, reply, len);
+        return;
+      }
+      if (claim)
+        http_release_refresh(cached_object);
+      release_cache(cached_object); // 본문을 읽을 수 없으면 미스로 처리
+      cached_object = NULL;
+    }
+    if (cached_object)
+    {
+      http_conditional(cached_object, cond, sizeof(cond));
+      n = http_add_conditional(out, n, UPSTREAM_BUFSIZE, cond);
+      c->stale = cached_object;
+    }
+  }
+
+  free(c->buf);
+  c->buf = out;
+  c->cap = UPSTREAM_BUFSIZE;
+  c->len = n;
+  c->pos = 0;
+  c->path = get ? strdup(path) : NULL;
+  c->host = strdup(hostname);
+  c->port = strdup(port);
+
+  if (get && !c->stale)
+  {
+    c->flight = flight_join(loop->cache, path, &c->leader);
+    if (!c->leader && conn_follow_start(loop, c))
+      return;
+  }
+  conn_fetch(loop, c, 1);
+}
+
+/**
+ * conn_fetch 함수: 버퍼의 요청을 보낼 원격 서버 연결을 얻습니다. pooled이면 풀에 쉬는 연결을
+ * 먼저 재사용하고, 없으면 원격 서버 주소를 얻어 논블로킹 연결을 시작합니다.
+ */
+static void conn_fetch(evloop_t *loop, conn_t *c, int pooled)
+{
+  struct epoll_event ev;
+  int fd;
+
+  if (pooled && (fd = upstream_get(c->host, c->port)) >= 0)
+  {
+    ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    ev.data.u64 = (uintptr_t)c | EV_SERVER;
+    if (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, fd, &ev) == 0)
+    {
+      c->serverfd = fd;
+      c->reused = 1;
+      c->state = C_SEND_REQ;
+      conn_run(loop, c, 1);
+      return;
+    }
+    close(fd);
+  }
+  c->reused = 0;
+  conn_resolve(loop, c);
+}
+
+/**
+ * conn_finish 함수: 응답 중계가 끝난 연결의 본문을 캐시에 저장하고 연결을 종료합니다.
+ */
+static void conn_finish(evloop_t *loop, conn_t *c)
+{
+  web_object_t *web_object = scan_object(&c->scan, c->path, c->reqflags);
+  if (web_object)
+    write_cache(loop->cache, web_object);
+  conn_close(loop, c);
+}
+
+/**
+ * conn_revalidated 함수: 재검증 요청에 304가 오면 캐시된 본문을 갱신된 헤더와 함께 응답하고,
+ * 갱신된 객체로 캐시의 객체를 바꿉니다.
+ */
+static void conn_revalidated(evloop_t *loop, conn_t *c)
+{
+  int storable;
+  size_t len;
+  web_object_t *fresh = http_refresh(c->stale, c->scan.hdr, c->reqflags,
+                                     c->scan.request_time, c->scan.response_time, &storable);
+  char *out = dup_cache_response(fresh ? fresh : c->stale, &len, 0);
+
+  if (fresh && storable)
+    write_cache(loop->cache, fresh);
+  else if (fresh)
+    free_cache_object(fresh);
+  release_cache(c->stale);
+  c->stale = NULL;
+  conn_release_server(loop, c);
+  if (out)
+    conn_reply(loop, c, out, len);
+  else
+    conn_error(loop, c, "", "502", "Bad Gateway", "📍 Failed to read the cached object");
+}
+
+/**
+ * conn_relay 함수: 서버 → 클라이언트 방향으로 읽을 수 있고 쓸 수 있는 만큼 데이터를 옮깁니다.
+ * edge-triggered 모드이므로 양쪽이 모두 EAGAIN이 될 때까지 반복합니다.
+ * 중계 버퍼가 가득 차면 클라이언트가 비울 때까지 서버에서 읽지 않습니다 (배압).
+ * 재검증 중이면 응답 상태를 알 때까지 클라이언트에 쓰지 않습니다 (304나 오류면 캐시 객체로 응답).
+ * 헤더는 다 받은 뒤 홉별 필드를 빼고 Connection: close를 붙여 보냅니다 (relay_header).
+ * 응답의 끝은 Content-length로 알고, 모르면 원격 서버가 연결을 닫을 때까지 중계합니다.
+ */
+static void conn_relay(evloop_t *loop, conn_t *c)
+{
+  ssize_t n;
+  int progress;
+
+  do
+  {
+    progress = 0;
+    if (!c->server_eof && c->rlen < RELAY_BUFSIZE)
+    {
+      n = read(c->serverfd, c->relay + c->rlen, RELAY_BUFSIZE - c->rlen);
+      if (n > 0)
+      {
+        scan_response(&c->scan, c->relay + c->rlen, n);
+        if (c->leader)
+          scan_share(&c->scan, c->flight, c->path, c->reqflags);
+        c->rlen += n;
+        c->server_eof = scan_done(&c->scan); // 연결을 유지하는 원격 서버는 닫지 않음
+        progress = 1;
+      }
+      else if ((n == 0 || (errno != EAGAIN && errno != EINTR)) && c->reused && c->scan.hdr_len == 0)
+      {
+        conn_retry(loop, c); // 풀에서 꺼낸 연결이 이미 닫혀 있었음
+        return;
+      }
+      else if (n == 0)
+      {
+        c->server_eof = 1;
+        progress = 1;
+      }
+      else if (errno != EAGAIN && errno != EINTR)
+      {
+        conn_close(loop, c);
+        return;
+      }
+    }
+    if (c->stale)
+    {
+      if (c->scan.hdr_done && c->scan.status == 304 && c->scan.hdr_len < c->scan.hdr_cap - 1)
+      {
+        conn_revalidated(loop, c);
+        return;
+      }
+      if (((c->scan.hdr_done && c->scan.status >= 500) || (c->server_eof && c->rlen == 0)) &&
+          http_serve_stale(c->stale, c->reqflags, 1))
+      {
+        conn_serve_stale(loop, c); // 원격 서버 오류
+        return;
+      }
+      if (!c->scan.hdr_done && !c->server_eof && c->rlen < RELAY_BUFSIZE)
+        continue; // 헤더를 더 받아야 함
+      release_cache(c->stale); // 새 응답이므로 그대로 중계
+      c->stale = NULL;
+    }
+    if (!c->hdr_sent)
+    {
+      if (!c->scan.hdr_done && !c->server_eof && c->rlen < RELAY_BUFSIZE)
+        continue; // 헤더를 더 받아야 함
+      c->rlen = relay_header(&c->scan, c->relay, c->rlen, RELAY_BUFSIZE + RELAY_HDR_ROOM);
+      c->hdr_sent = 1;
+    }
+    if (c->rpos < c->rlen)
+    {
+      n = write(c->clientfd, c->relay + c->rpos, c->rlen - c->rpos);
+      if (n > 0)
+      {
+        c->rpos += n;
+        if (c->rpos == c->rlen)
+          c->rpos = c->rlen = 0;
+        progress = 1;
+      }
+      else if (errno != EAGAIN && errno != EINTR)
+      {
+        conn_close(loop, c);
+        return;
+      }
+    }
+    if (c->server_eof && c->rpos == c->rlen)
+    {
+      conn_finish(loop, c);
+      return;
+    }
+  } while (progress);
+}
+
+/**
+ * conn_run 함수: 연결의 상태 기계를 진행할 수 있는 만큼 진행합니다.
+ * from_server: 이벤트가 서버 소켓에서 발생했으면 1
+ */
+static void conn_run(evloop_t *loop, conn_t *c, int from_server)
+{
+  ssize_t n;
+  int err;
+  socklen_t errlen = sizeof(err);
+  uint64_t count;
+
+  switch (c->state)
+  {
+  case C_READ_REQ:
+    while (1)
+    {
+      n = read(c->clientfd, c->buf + c->len, c->cap - 1 - c->len);
+      if (n > 0)
+      {
+        c->len += n;
+        c->buf[c->len] = '\0';
+        if (strstr(c->buf, "\r\n\r\n"))
+        {
+          conn_request(loop, c);
+          return;
+        }
+        if (c->len == c->cap - 1)
+        {
+          conn_error(loop, c, "", "400", "Bad Request", "Request header too long");
+          return;
+        }
+      }
+      else if (n < 0 && (errno == EAGAIN || errno == EINTR))
+        return;
+      else
+      {
+        conn_close(loop, c); // EOF 또는 오류
+        return;
+      }
+    }
+
+  case C_RESOLVE:
+    if (read(c->efd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+    {
+      conn_close(loop, c);
+      return;
+    }
+    conn_resolve(loop, c); // 깨어났으면 해석이 끝났음
+    return;
+
+  case C_CONNECT:
+    if (!from_server)
+      return;
+    conn_timer_remove(loop, c);
+    if (getsockopt(c->serverfd, SOL_SOCKET, SO_ERROR, &err, &errlen) < 0 || err)
+    {
+      // 이 주소로의 연결 실패, 다음 후보 시도
+      close(c->serverfd);
+      c->serverfd = -1;
+      c->addr++;
+      conn_connect(loop, c);
+      return;
+    }
+    c->state = C_SEND_REQ;
+    /* fall through */
+
+  case C_SEND_REQ:
+    while (c->pos < c->len)
+    {
+      n = write(c->serverfd, c->buf + c->pos, c->len - c->pos);
+      if (n > 0)
+        c->pos += n;
+      else if (errno == EAGAIN || errno == EINTR)
+        return;
+      else if (c->reused)
+      {
+        conn_retry(loop, c); // 풀에서 꺼낸 연결이 이미 닫혀 있었음
+        return;
+      }
+      else
+      {
+        conn_close(loop, c);
+        return;
+      }
+    }
+    // 요청 전송 완료, 버퍼를 응답 헤더 수집용으로 재사용
+    scan_init(&c->scan, c->buf, c->cap, !c->path);
+    c->relay = Malloc(RELAY_BUFSIZE + RELAY_HDR_ROOM);
+    c->state = C_RELAY;
+    /* fall through */
+
+  case C_RELAY:
+    conn_relay(loop, c);
+    return;
+
+  case C_WRITE_CLIENT:
+    while (c->pos < c->len)
+    {
+      n = write(c->clientfd, c->buf + c->pos, c->len - c->pos);
+      if (n > 0)
+        c->pos += n;
+      else if (errno == EAGAIN || errno == EINTR)
+        return;
+      else
+        break;
+    }
+    conn_close(loop, c);
+    return;
+
+  case C_FOLLOW:
+    conn_follow(loop, c);
+    return;
+
+  case C_DONE:
+    return;
+  }
+}
+
+/**
+ * event_sweep 함수: 기한 안에 연결되지 않은 연결 시도를 버리고 다음 주소 후보로 넘어갑니다.
+ * 이번 배치의 이벤트를 모두 처리한 뒤, 종료된 연결을 해제하기 전에 부릅니다.
+ */
+static void event_sweep(evloop_t *loop, long now)
+{
+  conn_t *c, *next;
+
+  loop->next_sweep = now + EV_TIMER_TICK;
+  for (c = loop->timers; c; c = next)
+  {
+    next = c->timer_next; // 다음 후보의 시도는 목록 앞에 들어가므로 다시 보지 않음
+    if (c->deadline > now)
+      continue;
+    conn_timer_remove(loop, c);
+    close(c->serverfd); // 응답하지 않는 주소 (epoll에서도 빠짐)
+    c->serverfd = -1;
+    c->addr++;
+    conn_connect(loop, c);
+  }
+}
+
+/**
+ * event_accept 함수: 리스닝 소켓의 대기 중인 연결을 EAGAIN이 될 때까지 모두 수락하고
+ * 각 연결을 이 루프의 epoll에 등록합니다.
+ */
+static void event_accept(evloop_t *loop)
+{
+  struct epoll_event ev;
+  int clientfd;
+
+  while ((clientfd = accept4(loop->listenfd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0)
+  {
+    conn_t *c = Calloc(1, sizeof(conn_t));
+    c->clientfd = clientfd;
+    c->serverfd = -1;
+    c->efd = -1;
+    c->cap = REQ_BUFSIZE;
+    c->buf = Malloc(c->cap);
+    c->state = C_READ_REQ;
+
+    ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    ev.data.u64 = (uintptr_t)c;
+    if (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, clientfd, &ev) < 0)
+    {
+      close(clientfd);
+      conn_free(c);
+    }
+  }
+}
+
+/**
+ * event_loop 함수: 이벤트 루프 스레드의 본체입니다.
+ * 리스닝 소켓은 EPOLLEXCLUSIVE로 등록하여 새 연결마다 루프 하나만 깨어나도록 합니다.
+ *
+ * vargp: 이 스레드의 evloop_t 포인터
+ */
+static void *event_loop(void *vargp)
+{
+  evloop_t *loop = (evloop_t *)vargp;
+  struct epoll_event ev, events[EV_MAXEVENTS];
+  int i, n;
+
+  if (loop->cpu >= 0)
+  {
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(loop->cpu, &cpus);
+    pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+  }
+  if ((loop->epfd = epoll_create1(EPOLL_CLOEXEC)) < 0)
+    unix_error("epoll_create1 error");
+  ev.events = EPOLLIN | EPOLLEXCLUSIVE;
+  ev.data.u64 = 0;
+  if (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, loop->listenfd, &ev) < 0)
+    unix_error("epoll_ctl error");
+
+  while (1)
+  {
+    if ((n = epoll_wait(loop->epfd, events, EV_MAXEVENTS, loop->timers ? EV_TIMER_TICK : -1)) < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      unix_error("epoll_wait error");
+    }
+
+    for (i = 0; i < n; i++)
+    {
+      uint64_t data = events[i].data.u64;
+      if (data == 0)
+        event_accept(loop);
+      else
+        conn_run(loop, (conn_t *)(uintptr_t)(data & ~(uint64_t)(EV_SERVER | EV_FLIGHT)), data & EV_SERVER);
+    }
+    if (loop->timers && ev_now() >= loop->next_sweep)
+      event_sweep(loop, ev_now());
+
+    // 이번 배치에서 종료된 연결 해제
+    while (loop->closed)
+    {
+      conn_t *c = loop->closed;
+      loop->closed = c->next_closed;
+      conn_free(c);
+    }
+  }
+  return NULL;
+}
+
+/**
+ * event_main 함수: epoll 모드의 진입점입니다. 리스닝 소켓을 논블로킹으로 바꾸고
+ * nloops개의 이벤트 루프를 실행합니다. 호출한 스레드도 루프 하나를 맡으며 반환하지 않습니다.
+ *
+ * listenfd: 리스닝 소켓
+ * nloops: 이벤트 루프 스레드 수
+ */
+void event_main(int listenfd, int nloops)
+{
+  pthread_t tid;
+  int i;
+  evloop_t *loops = Calloc(nloops, sizeof(evloop_t));
+
+  fcntl(listenfd, F_SETFL, fcntl(listenfd, F_GETFL) | O_NONBLOCK);
+  for (i = 0; i < nloops; i++)
+  {
+    loops[i].listenfd = listenfd;
+    loops[i].cache = &proxy_cache;
+    loops[i].cpu = -1;
+  }
+  for (i = 1; i < nloops; i++)
+    Pthread_create(&tid, NULL, event_loop, &loops[i]);
+  event_loop(&loops[0]);
+}
+
+/**
+ * attach_steering 함수: reuseport 그룹에 클라이언트 주소 기반 CBPF 조향 프로그램을 붙입니다.
+ * 프로그램은 발신지 IP 주소(IPv6는 마지막 32비트)를 샤드 수로 나눈 나머지를 반환하므로,
+ * 같은 클라이언트의 연결은 항상 같은 샤드(같은 캐시 파티션)로 갑니다.
+ * 반환 값이 소켓 인덱스이므로 리스닝 소켓은 샤드 순서대로 열려 있어야 합니다.
+ *
+ * listenfd: 그룹에 속한 리스닝 소켓 하나
+ * nshards: 샤드 수
+ * 반환: 성공하면 0, 실패하면 -1
+ */
+static int attach_steering(int listenfd, int nshards)
+{
+  struct sock_filter code[] = {
+    BPF_STMT(BPF_LD | BPF_B | BPF_ABS, SKF_NET_OFF),           // A = IP 버전 바이트
+    BPF_STMT(BPF_ALU | BPF_RSH | BPF_K, 4),
+    BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 6, 0, 2),
+    BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_NET_OFF + 20),      // IPv6 발신지 주소의 마지막 32비트
+    BPF_STMT(BPF_JMP | BPF_JA, 1),
+    BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_NET_OFF + 12),      // IPv4 발신지 주소
+    BPF_STMT(BPF_ALU | BPF_MOD | BPF_K, nshards),
+    BPF_STMT(BPF_RET | BPF_A, 0),
+  };
+  struct sock_fprog prog = { sizeof(code) / sizeof(code[0]), code };
+
+  return setsockopt(listenfd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog));
+}
+
+/**
+ * event_shard_main 함수: shard 모드의 진입점입니다.
+ * 샤드마다 SO_REUSEPORT 리스닝 소켓, 이벤트 루프, 전용 캐시 파티션을 만들고
+ * 각 샤드를 CPU 하나에 고정합니다. 전체 캐시 크기는 샤드들이 나누어 가집니다.
+ * 반환하지 않습니다.
+ *
+ * port: 리스닝 포트
+ * nshards: 샤드 수
+ * steer: 0이 아니면 CBPF로 클라이언트 주소에 따라 샤드를 고정
+ */
+void event_shard_main(char *port, int nshards, int steer)
+{
+  pthread_t tid;
+  int i, ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+  evloop_t *loops = Calloc(nshards, sizeof(evloop_t));
+
+  for (i = 0; i < nshards; i++)
+  {
+    loops[i].listenfd = Open_listenfd_reuseport(port);
+    fcntl(loops[i].listenfd, F_SETFL, fcntl(loops[i].listenfd, F_GETFL) | O_NONBLOCK);
+    loops[i].cache = Malloc(sizeof(cache_t));
+    cache_init(loops[i].cache, MAX_CACHE_SIZE / nshards, proxy_cache.policy); // 정책은 기본 캐시와 같게
+    loops[i].cpu = i % ncpus;
+  }
+  if (steer && attach_steering(loops[0].listenfd, nshards) < 0)
+    fprintf(stderr, "SO_ATTACH_REUSEPORT_CBPF failed (%s), using kernel hash\n", strerror(errno));
+
+  for (i = 1; i < nshards; i++)
+    Pthread_create(&tid, NULL, event_loop, &loops[i]);
+  event_loop(&loops[0]);
+}
@@ -0,0 +1,204 @@
+#include "flight.h"
+
+/*
+ * flight.c - 같은 URL에 대한 동시 캐시 미스 병합 (collapsed forwarding)
+ *
+ * 캐시가 비어 있을 때 같은 객체에 요청이 몰리면 요청마다 원격 서버에 연결하는 대신,
+ * 처음 미스한 요청(리더)만 원격 서버에서 받아 오고 나머지(팔로워)는 리더의 flight_t에
+ * 붙어 응답 바이트를 도착하는 대로 받아 갑니다 (read-while-write). 캐시에는 리더만 넣습니다.
+ *
+ * 리더는 응답 헤더를 보고 캐시할 수 있는 응답이면 flight_start로 전체 길이를 알린 뒤
+ * flight_publish로 바이트를 공개하고, 캐시할 수 없으면 곧바로 flight_end로 거절합니다
+ * (거절된 팔로워는 직접 원격 서버에 요청). 공개 버퍼는 MAX_OBJECT_SIZE와 헤더 길이로 제한됩니다.
+ *
+ * 팔로워는 자기 eventfd를 flight_watch로 등록하고, 공개될 때마다 깨어나 flight_poll로
+ * 새 바이트를 확인합니다. eventfd는 스레드(poll), 코루틴(rio_wait_hook), epoll, io_uring이
+ * 모두 같은 방식으로 기다릴 수 있습니다.
+ */
+
+static pthread_mutex_t table_lock = PTHREAD_MUTEX_INITIALIZER;
+static flight_t *table[FLIGHT_BUCKETS];
+
+/**
+ * flight_wake 함수: 등록된 팔로워들을 깨웁니다. f->lock을 잡은 상태에서 불립니다.
+ */
+static void flight_wake(flight_t *f)
+{
+  uint64_t one = 1;
+  int i;
+
+  for (i = 0; i < f->nwatchers; i++)
+    if (write(f->watchers[i], &one, sizeof(one)) < 0 && errno != EAGAIN)
+      continue; // 팔로워가 떠나는 중 (다음 flight_poll에서 상태를 확인함)
+}
+
+/**
+ * flight_unlink 함수: 요청을 표에서 떼어냅니다. 이후 미스는 새 요청을 시작합니다.
+ */
+static void flight_unlink(flight_t *f)
+{
+  flight_t **pp;
+
+  pthread_mutex_lock(&table_lock);
+  for (pp = &table[f->hash & (FLIGHT_BUCKETS - 1)]; *pp; pp = &(*pp)->next)
+  {
+    if (*pp == f)
+    {
+      *pp = f->next;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&table_lock);
+}
+
+/**
+ * flight_join 함수: 캐시 키에 대해 진행 중인 원격 요청에 붙거나, 없으면 새로 시작합니다.
+ * cache, path: 캐시와 캐시 키
+ * leader: 새로 시작했으면 1 (호출자가 리더로서 받아 오고 끝나면 flight_end를 불러야 함)
+ * 반환: 원격 요청 (끝나면 flight_leave로 참조를 놓아야 함)
+ */
+flight_t *flight_join(cache_t *cache, char *path, int *leader)
+{
+  uint64_t hash = cache_hash(path);
+  flight_t *f, **bucket = &table[hash & (FLIGHT_BUCKETS - 1)];
+
+  pthread_mutex_lock(&table_lock);
+  for (f = *bucket; f; f = f->next)
+  {
+    if (f->hash == hash && f->cache == cache && !strcmp(f->path, path))
+    {
+      __atomic_add_fetch(&f->refcnt, 1, __ATOMIC_RELAXED);
+      pthread_mutex_unlock(&table_lock);
+      *leader = 0;
+      return f;
+    }
+  }
+
+  f = Calloc(1, sizeof(flight_t));
+  f->cache = cache;
+  f->hash = hash;
+  f->path = strdup(path);
+  f->refcnt = 1;
+  f->state = FLIGHT_PENDING;
+  pthread_mutex_init(&f->lock, NULL);
+  f->next = *bucket;
+  *bucket = f;
+  pthread_mutex_unlock(&table_lock);
+  *leader = 1;
+  return f;
+}
+
+/**
+ * flight_start 함수: 리더가 응답을 나누기 시작합니다.
+ * size: 응답 전체의 길이 (상태 줄, 헤더, 본문)
+ */
+void flight_start(flight_t *f, size_t size)
+{
+  char *data = Malloc(size);
+
+  pthread_mutex_lock(&f->lock);
+  f->data = data;
+  f->size = size;
+  f->state = FLIGHT_STREAM;
+  pthread_mutex_unlock(&f->lock);
+}
+
+/**
+ * flight_publish 함수: 리더가 받은 응답 바이트를 팔로워들에게 공개합니다.
+ * flight_start로 알린 길이를 넘는 바이트는 버리고, 요청은 끝날 때 실패로 처리됩니다.
+ */
+void flight_publish(flight_t *f, char *data, size_t n)
+{
+  if (f->state != FLIGHT_STREAM || n == 0) // 상태는 리더만 바꾸므로 락 없이 읽어도 됨
+    return;
+  if (n > f->size - f->len)
+    n = f->size - f->len;
+  memcpy(f->data + f->len, data, n); // 아직 공개되지 않은 영역이므로 락 밖에서 복사
+
+  pthread_mutex_lock(&f->lock);
+  f->len += n;
+  flight_wake(f);
+  pthread_mutex_unlock(&f->lock);
+}
+
+/**
+ * flight_end 함수: 리더가 요청을 끝냅니다. 응답을 모두 공개했으면 완료, 시작하기 전이면 거절,
+ * 도중이면 실패입니다. 요청은 표에서 떼어지므로 캐시에 넣은 뒤에 불러야 합니다.
+ * 여러 번 불러도 됩니다.
+ */
+void flight_end(flight_t *f)
+{
+  int first;
+
+  pthread_mutex_lock(&f->lock);
+  first = f->state == FLIGHT_PENDING || f->state == FLIGHT_STREAM;
+  if (f->state == FLIGHT_PENDING)
+    f->state = FLIGHT_DECLINED;
+  else if (f->state == FLIGHT_STREAM)
+    f->state = f->len == f->size ? FLIGHT_DONE : FLIGHT_FAILED;
+  flight_wake(f);
+  pthread_mutex_unlock(&f->lock);
+  if (first)
+    flight_unlink(f);
+}
+
+/**
+ * flight_watch 함수: 팔로워의 eventfd를 등록합니다. 이후 공개되거나 끝날 때마다 깨어납니다.
+ * 등록한 뒤에 flight_poll로 상태를 확인해야 깨우기를 놓치지 않습니다.
+ */
+void flight_watch(flight_t *f, int efd)
+{
+  pthread_mutex_lock(&f->lock);
+  if (f->nwatchers == f->watchers_cap)
+  {
+    f->watchers_cap = f->watchers_cap ? f->watchers_cap * 2 : 8;
+    f->watchers = Realloc(f->watchers, f->watchers_cap * sizeof(int));
+  }
+  f->watchers[f->nwatchers++] = efd;
+  pthread_mutex_unlock(&f->lock);
+}
+
+/**
+ * flight_poll 함수: 요청의 상태와 공개된 길이를 확인합니다.
+ * len: 공개된 길이를 저장할 위치 (f->data의 그만큼은 락 없이 읽어도 됨)
+ */
+enum flight_state flight_poll(flight_t *f, size_t *len)
+{
+  enum flight_state state;
+
+  pthread_mutex_lock(&f->lock);
+  state = f->state;
+  *len = f->len;
+  pthread_mutex_unlock(&f->lock);
+  return state;
+}
+
+/**
+ * flight_leave 함수: 등록한 eventfd를 빼고 요청의 참조를 놓습니다. 마지막 참조면 해제합니다.
+ * efd: flight_watch로 등록한 eventfd (없으면 -1, 닫는 것은 호출자의 몫)
+ */
+void flight_leave(flight_t *f, int efd)
+{
+  int i;
+
+  if (efd >= 0)
+  {
+    pthread_mutex_lock(&f->lock);
+    for (i = 0; i < f->nwatchers; i++)
+    {
+      if (f->watchers[i] == efd)
+      {
+        f->watchers[i] = f->watchers[--f->nwatchers];
+        break;
+      }
+    }
+    pthread_mutex_unlock(&f->lock);
+  }
+  if (__atomic_sub_fetch(&f->refcnt, 1, __ATOMIC_ACQ_REL) > 0)
+    return;
+  pthread_mutex_destroy(&f->lock);
+  free(f->data);
+  free(f->watchers);
+  free(f->path);
+  free(f);
+}
@@ -0,0 +1,54 @@
+#ifndef __FLIGHT_H__
+#define __FLIGHT_H__
+
+#include <stdint.h>
+#include "csapp.h"
+#include "cache.h"
+
+#define FLIGHT_BUCKETS 256 // 진행 중인 요청 표의 해시 버킷 수 (2의 거듭제곱)
+
+/* 진행 중인 원격 요청의 상태 */
+enum flight_state
+{
+  FLIGHT_PENDING,  // 리더가 응답 헤더를 기다리는 중
+  FLIGHT_STREAM,   // 리더가 응답을 받는 대로 공개하는 중
+  FLIGHT_DONE,     // 응답을 모두 공개함
+  FLIGHT_FAILED,   // 응답을 다 받기 전에 리더가 끝남 (팔로워도 연결을 끊음)
+  FLIGHT_DECLINED  // 캐시할 수 없는 응답이라 나누지 않음 (팔로워가 직접 요청)
+};
+
+/**
+ * flight_t 구조체: 같은 캐시 키로 동시에 들어온 캐시 미스들이 함께 기다리는 원격 요청 하나입니다.
+ * 처음 미스한 요청(리더)만 원격 서버에서 받아 오고, 나머지(팔로워)는 리더가 공개하는 응답
+ * 바이트를 도착하는 대로 자기 클라이언트에 보냅니다.
+ * next: 해시 버킷의 다음 요청, cache/hash/path: 캐시 키
+ * refcnt: 리더와 팔로워의 참조 수
+ * data, len, size: 공개된 응답 (상태 줄, 헤더, 본문)과 공개된 길이, 전체 길이
+ *                  (data[0, len)은 공개된 뒤 바뀌지 않으므로 락 없이 읽어도 됨)
+ * watchers, nwatchers: 공개될 때마다 깨울 팔로워들의 eventfd
+ */
+typedef struct flight_t
+{
+  struct flight_t *next;
+  cache_t *cache;
+  uint64_t hash;
+  char *path;
+  int refcnt;
+  pthread_mutex_t lock;
+  enum flight_state state;
+  char *data;
+  size_t len, size;
+  int *watchers;
+  int nwatchers, watchers_cap;
+} flight_t;
+
+// 요청 병합 함수 선언
+flight_t *flight_join(cache_t *cache, char *path, int *leader);
+void flight_start(flight_t *f, size_t size);
+void flight_publish(flight_t *f, char *data, size_t n);
+void flight_end(flight_t *f);
+void flight_watch(flight_t *f, int efd);
+enum flight_state flight_poll(flight_t *f, size_t *len);
+void flight_leave(flight_t *f, int efd);
+
+#endif /* __FLIGHT_H__ */
@@ -0,0 +1,562 @@
+#define _GNU_SOURCE
+#include <time.h>
+#include "proxy.h"
+
+/*
+ * httpcache.c - HTTP 캐시 규칙 (RFC 9111)
+ *
+ * 원격 서버의 응답을 캐시에 저장해도 되는지, 저장한다면 언제까지 신선한지를 응답 헤더
+ * (Cache-Control, Expires, Date, Age, Last-Modified, ETag, Vary)로 정합니다.
+ * 신선 기간이 지난 객체는 저장해 둔 검증자(ETag, Last-Modified)로 조건부 요청을 보내고,
+ * 304가 오면 본문을 다시 받지 않고 헤더만 갱신한 객체로 바꿉니다.
+ *
+ * 명시적인 만료 정보가 없는 응답은 휴리스틱으로 신선 기간을 정합니다. Last-Modified가 있으면
+ * 마지막 수정 뒤 지난 시간의 1/10 (최대 하루), 없으면 HTTP_DEFAULT_TTL입니다. 질의 문자열이
+ * 있거나 cgi-bin 아래의 동적 응답은 명시적인 만료 정보가 있을 때만 저장합니다.
+ *
+ * 신선 기간이 막 지난 객체는 stale-while-revalidate 동안 그대로 보내고, 재검증은 객체마다
+ * 하나씩만 백그라운드에서 진행합니다. 원격 서버에 연결할 수 없거나 5xx를 보내면
+ * stale-if-error 동안 신선하지 않은 객체로 대신 응답합니다 (RFC 5861).
+ */
+
+#define HTTP_DEFAULT_TTL 300        // 만료 정보도 Last-Modified도 없는 응답의 신선 기간 (초)
+#define HTTP_HEURISTIC_FRACTION 10  // Last-Modified 휴리스틱: 마지막 수정 뒤 지난 시간의 1/10
+#define HTTP_HEURISTIC_MAX 86400    // 휴리스틱 신선 기간의 상한 (초)
+#define HTTP_DEFAULT_SWR 60         // 휴리스틱으로 신선 기간을 정한 객체의 stale-while-revalidate (초)
+#define HTTP_DEFAULT_SIE 3600       // stale-if-error가 없는 객체를 오류 시 보낼 수 있는 시간 (초)
+#define HTTP_MAX_REFRESH 64         // 동시에 진행할 수 있는 백그라운드 재검증 수
+
+/**
+ * cache_control_t 구조체: 응답의 Cache-Control 지시자들입니다.
+ * max_age, s_maxage, swr, sie: 지시자의 값 (없으면 -1, swr과 sie는 RFC 5861의
+ * stale-while-revalidate와 stale-if-error)
+ */
+typedef struct cache_control_t
+{
+  int no_store, no_cache, is_private, is_public, must_revalidate;
+  long max_age, s_maxage, swr, sie;
+} cache_control_t;
+
+// 백그라운드 재검증 중인 객체들 (객체마다 하나만 진행)
+static pthread_mutex_t refresh_lock = PTHREAD_MUTEX_INITIALIZER;
+static web_object_t *refreshing[HTTP_MAX_REFRESH];
+
+/**
+ * http_field 함수: 헤더 블록에서 *pos부터 이름이 name인 다음 필드를 찾습니다.
+ * 헤더 블록은 NUL로 끝나야 하며, 빈 줄을 만나면 찾기를 멈춥니다.
+ * pos: 찾기 시작할 위치 (찾으면 그 필드의 다음 줄로 옮김)
+ * len: 찾은 값의 길이 (앞뒤 공백 제외)
+ * 반환: 필드 값의 시작, 없으면 NULL
+ */
+static char *http_field(char **pos, const char *name, size_t *len)
+{
+  size_t nlen = strlen(name);
+  char *line, *eol, *v;
+
+  for (line = *pos; (eol = strstr(line, "\r\n")) && eol != line; line = eol + 2)
+  {
+    if (strncasecmp(line, name, nlen) || line[nlen] != ':')
+      continue;
+    for (v = line + nlen + 1; *v == ' ' || *v == '\t'; v++)
+      ;
+    for (*len = eol - v; *len > 0 && (v[*len - 1] == ' ' || v[*len - 1] == '\t'); (*len)--)
+      ;
+    *pos = eol + 2;
+    return v;
+  }
+  return NULL;
+}
+
+/**
+ * http_value 함수: 이름이 name인 첫 필드의 값을 buf에 NUL로 끝나게 복사합니다.
+ * 반환: 필드가 있으면 1, 없으면 0
+ */
+static int http_value(char *hdr, const char *name, char *buf, size_t cap)
+{
+  size_t len;
+  char *v = http_field(&hdr, name, &len);
+
+  if (!v)
+    return 0;
+  if (len >= cap)
+    len = cap - 1;
+  memcpy(buf, v, len);
+  buf[len] = '\0';
+  return 1;
+}
+
+/**
+ * http_date 함수: HTTP 날짜(IMF-fixdate, RFC 850, asctime 형식)를 해석합니다.
+ * 반환: 시각, 해석할 수 없으면 -1
+ */
+static time_t http_date(char *s)
+{
+  struct tm tm;
+
+  memset(&tm, 0, sizeof(tm));
+  if (strptime(s, "%a, %d %b %Y %H:%M:%S GMT", &tm) ||
+      strptime(s, "%A, %d-%b-%y %H:%M:%S GMT", &tm) ||
+      strptime(s, "%a %b %d %H:%M:%S %Y", &tm))
+    return timegm(&tm);
+  return -1;
+}
+
+/**
+ * http_delta 함수: delta-seconds 값을 해석합니다. 잘못된 값은 0 (곧 만료)으로 봅니다.
+ */
+static long http_delta(char *s, size_t len)
+{
+  long v = 0;
+
+  while (len-- > 0 && isdigit((unsigned char)*s))
+  {
+    v = v * 10 + (*s++ - '0');
+    if (v > INT32_MAX)
+      return INT32_MAX;
+  }
+  return v;
+}
+
+/**
+ * http_cache_control 함수: 모든 Cache-Control 필드의 지시자를 모읍니다.
+ */
+static void http_cache_control(char *hdr, cache_control_t *cc)
+{
+  char *pos = hdr, *v, *end, *tok, *eq;
+  size_t len, tlen;
+
+  memset(cc, 0, sizeof(*cc));
+  cc->max_age = cc->s_maxage = cc->swr = cc->sie = -1;
+  while ((v = http_field(&pos, "Cache-Control", &len)))
+  {
+    for (end = v + len; v < end; v = tok + tlen + 1)
+    {
+      for (tok = v; tok < end && (*tok == ' ' || *tok == '\t'); tok++)
+        ;
+      for (tlen = 0; tok + tlen < end && tok[tlen] != ','; tlen++)
+        ;
+      eq = memchr(tok, '=', tlen);
+      if (eq && eq[1] == '"') // 따옴표로 둘러싼 값
+        eq++;
+#define CC_IS(name) (!strncasecmp(tok, name, strlen(name)) && \
+                     (tok + strlen(name) == tok + tlen || tok[strlen(name)] == '=' || tok[strlen(name)] == ' '))
+      if (CC_IS("no-store"))
+        cc->no_store = 1;
+      else if (CC_IS("no-cache")) // no-cache="필드"도 보수적으로 응답 전체에 적용
+        cc->no_cache = 1;
+      else if (CC_IS("private"))
+        cc->is_private = 1;
+      else if (CC_IS("public"))
+        cc->is_public = 1;
+      else if (CC_IS("must-revalidate") || CC_IS("proxy-revalidate"))
+        cc->must_revalidate = 1;
+      else if (CC_IS("max-age") && eq)
+        cc->max_age = http_delta(eq + 1, tok + tlen - eq - 1);
+      else if (CC_IS("s-maxage") && eq)
+        cc->s_maxage = http_delta(eq + 1, tok + tlen - eq - 1);
+      else if (CC_IS("stale-while-revalidate") && eq)
+        cc->swr = http_delta(eq + 1, tok + tlen - eq - 1);
+      else if (CC_IS("stale-if-error") && eq)
+        cc->sie = http_delta(eq + 1, tok + tlen - eq - 1);
+#undef CC_IS
+    }
+  }
+}
+
+/**
+ * http_status 함수: 응답 상태 줄의 상태 코드를 읽습니다.
+ * 반환: 상태 코드, 상태 줄이 아니면 0
+ */
+int http_status(char *hdr)
+{
+  int status;
+
+  if (sscanf(hdr, "HTTP/%*d.%*d %d", &status) != 1)
+    return 0;
+  return status;
+}
+
+/**
+ * http_heuristic_status 함수: 휴리스틱 신선 기간을 줄 수 있는 상태 코드인지 확인합니다
+ * (RFC 9110 15.1, 프록시가 본문 전체를 저장할 수 있는 것만).
+ */
+static int http_heuristic_status(int status)
+{
+  switch (status)
+  {
+  case 200: case 203: case 204: case 300: case 301: case 308:
+  case 404: case 405: case 410: case 414: case 501:
+    return 1;
+  }
+  return 0;
+}
+
+/**
+ * http_storable 함수: 응답을 캐시에 저장해도 되는지 판단하고, 된다면 만료 시각을 계산합니다.
+ * 만료 시각은 응답 시각 + 신선 기간 - 응답이 도착했을 때의 나이입니다 (RFC 9111 4.2).
+ * path: 요청 경로, reqflags: 요청 헤더 플래그 (HDR_NO_STORE, HDR_AUTHORIZATION)
+ * hdr: NUL로 끝나는 응답 상태 줄과 헤더
+ * request_time, response_time: 원격 서버에 요청을 보낸 시각과 응답 헤더를 받은 시각
+ * expires: 만료 시각을 저장할 위치
+ * 반환: 저장해도 되면 1, 아니면 0
+ */
+int http_storable(char *path, int reqflags, char *hdr, time_t request_time, time_t response_time, time_t *expires)
+{
+  cache_control_t cc;
+  char buf[MAXLINE], *pos = hdr;
+  int status = http_status(hdr), validators;
+  time_t date, t, apparent_age, corrected_age;
+  long lifetime;
+  size_t len;
+
+  if (status < 200 || status == 206 || status == 304) // 중간 응답, 부분 응답, 검증 응답
+    return 0;
+  http_cache_control(hdr, &cc);
+  if ((reqflags & HDR_NO_STORE) || cc.no_store || cc.is_private)
+    return 0;
+  if ((reqflags & HDR_AUTHORIZATION) && !cc.is_public && !cc.must_revalidate && cc.s_maxage < 0)
+    return 0;
+  if (http_field(&pos, "Vary", &len)) // 캐시 키가 경로뿐이므로 변형이 있는 응답은 저장하지 않음
+    return 0;
+
+  date = http_value(hdr, "Date", buf, sizeof(buf)) ? http_date(buf) : -1;
+  if (date < 0)
+    date = response_time;
+
+  // 신선 기간: s-maxage > max-age > Expires > 휴리스틱
+  if (cc.s_maxage >= 0)
+    lifetime = cc.s_maxage;
+  else if (cc.max_age >= 0)
+    lifetime = cc.max_age;
+  else if (http_value(hdr, "Expires", buf, sizeof(buf)))
+    lifetime = (t = http_date(buf)) < 0 ? 0 : t - date; // 잘못된 Expires는 이미 만료
+  else
+  {
+    if (!http_heuristic_status(status) || strchr(path, '?') || strstr(path, "/cgi-bin/"))
+      return 0;
+    if (http_value(hdr, "Last-Modified", buf, sizeof(buf)) && (t = http_date(buf)) >= 0)
+    {
+      lifetime = t < date ? (date - t) / HTTP_HEURISTIC_FRACTION : 0;
+      if (lifetime > HTTP_HEURISTIC_MAX)
+        lifetime = HTTP_HEURISTIC_MAX;
+    }
+    else
+      lifetime = HTTP_DEFAULT_TTL;
+  }
+  if (cc.no_cache)
+    lifetime = 0; // 저장은 하되 쓸 때마다 재검증
+
+  // 재검증할 수 없는 객체는 신선 기간이 없으면 저장할 이유가 없음
+  pos = hdr;
+  validators = http_field(&pos, "ETag", &len) || (pos = hdr, http_field(&pos, "Last-Modified", &len));
+  if (lifetime <= 0 && !validators)
+    return 0;
+
+  // 응답이 도착했을 때의 나이 (RFC 9111 4.2.3)
+  apparent_age = response_time > date ? response_time - date : 0;
+  corrected_age = (http_value(hdr, "Age", buf, sizeof(buf)) ? http_delta(buf, strlen(buf)) : 0) +
+                  (response_time - request_time);
+  *expires = response_time + lifetime - (apparent_age > corrected_age ? apparent_age : corrected_age);
+  return 1;
+}
+
+/**
+ * http_fresh 함수: 캐시된 객체를 재검증 없이 바로 보내도 되는지 확인합니다.
+ * reqflags: 요청 헤더 플래그 (HDR_NO_CACHE면 항상 재검증)
+ */
+int http_fresh(web_object_t *web_object, int reqflags)
+{
+  return !(reqflags & HDR_NO_CACHE) && time(NULL) < web_object->expires;
+}
+
+/**
+ * http_serve_stale 함수: 신선하지 않은 객체를 원격 서버의 응답을 기다리지 않고 보내도 되는지 확인합니다.
+ * 객체의 stale-while-revalidate 또는 stale-if-error 지시자를 따르고, 없으면 휴리스틱으로 신선 기간을
+ * 정한 객체에만 HTTP_DEFAULT_SWR, 오류 시에는 모든 객체에 HTTP_DEFAULT_SIE를 씁니다.
+ * must-revalidate, no-cache 응답이나 클라이언트가 no-cache를 보낸 요청에는 쓰지 않습니다.
+ * reqflags: 요청 헤더 플래그
+ * error: 0이면 재검증하는 동안, 1이면 원격 서버에 연결할 수 없거나 5xx를 받았을 때
+ */
+int http_serve_stale(web_object_t *web_object, int reqflags, int error)
+{
+  cache_control_t cc;
+  char *hdr = cache_header(web_object), *pos = hdr;
+  size_t len;
+  long window;
+
+  if (reqflags & HDR_NO_CACHE)
+    return 0;
+  http_cache_control(hdr, &cc);
+  if (cc.must_revalidate || cc.no_cache)
+    return 0;
+  window = error ? cc.sie : cc.swr;
+  if (window < 0 && error)
+    window = HTTP_DEFAULT_SIE;
+  else if (window < 0)
+    window = cc.max_age < 0 && cc.s_maxage < 0 && !http_field(&pos, "Expires", &len) ? HTTP_DEFAULT_SWR : 0;
+  return time(NULL) < web_object->expires + window;
+}
+
+/**
+ * http_claim_refresh 함수: 객체의 백그라운드 재검증을 맡습니다. 맡았으면 재검증이 끝난 뒤
+ * http_release_refresh를 불러야 하며, 그때까지 객체의 참조를 가지고 있어야 합니다.
+ * 반환: 맡았으면 1, 이미 다른 요청이 재검증 중이면 0, 동시 재검증 수가 가득 찼으면 -1
+ */
+int http_claim_refresh(web_object_t *web_object)
+{
+  int i, empty = -1;
+
+  pthread_mutex_lock(&refresh_lock);
+  for (i = 0; i < HTTP_MAX_REFRESH; i++)
+  {
+    if (refreshing[i] == web_object)
+    {
+      pthread_mutex_unlock(&refresh_lock);
+      return 0;
+    }
+    if (!refreshing[i] && empty < 0)
+      empty = i;
+  }
+  if (empty >= 0)
+    refreshing[empty] = web_object;
+  pthread_mutex_unlock(&refresh_lock);
+  return empty >= 0 ? 1 : -1;
+}
+
+/**
+ * http_release_refresh 함수: http_claim_refresh로 맡은 재검증을 끝냅니다.
+ */
+void http_release_refresh(web_object_t *web_object)
+{
+  int i;
+
+  pthread_mutex_lock(&refresh_lock);
+  for (i = 0; i < HTTP_MAX_REFRESH; i++)
+    if (refreshing[i] == web_object)
+      refreshing[i] = NULL;
+  pthread_mutex_unlock(&refresh_lock);
+}
+
+/**
+ * http_conditional 함수: 캐시된 객체의 검증자로 조건부 요청 헤더를 만듭니다.
+ * buf: 헤더 줄들을 쓸 버퍼, cap: 버퍼 크기
+ * 반환: 쓴 길이, 검증자가 없으면 0 (buf는 빈 문자열)
+ */
+int http_conditional(web_object_t *web_object, char *buf, size_t cap)
+{
+  char *hdr = cache_header(web_object), *pos, *v;
+  size_t len;
+  int n = 0;
+
+  buf[0] = '\0';
+  pos = hdr;
+  if ((v = http_field(&pos, "ETag", &len)) && len + 20 < cap - n)
+    n += sprintf(buf + n, "If-None-Match: %.*s\r\n", (int)len, v);
+  pos = hdr;
+  if ((v = http_field(&pos, "Last-Modified", &len)) && len + 24 < cap - n)
+    n += sprintf(buf + n, "If-Modified-Since: %.*s\r\n", (int)len, v);
+  return n;
+}
+
+/**
+ * http_is_conditional 함수: 헤더 줄이 재검증용 조건부 요청 헤더인지 확인합니다.
+ */
+static int http_is_conditional(char *line)
+{
+  return !strncasecmp(line, "If-None-Match:", strlen("If-None-Match:")) ||
+         !strncasecmp(line, "If-Modified-Since:", strlen("If-Modified-Since:"));
+}
+
+/**
+ * http_add_conditional 함수: 원격 서버로 보낼 요청에 프록시의 조건부 헤더를 넣습니다.
+ * 클라이언트가 보낸 조건부 헤더는 빼므로, 304는 캐시된 객체에 대한 답이 됩니다.
+ * req: build_request가 만든 요청 (빈 줄로 끝남), n: 그 길이, cap: 버퍼 크기
+ * cond: http_conditional이 만든 헤더 줄들 (빈 문자열이면 클라이언트의 조건부 헤더만 뺌)
+ * 반환: 새 요청의 길이 (넣을 자리가 없으면 원래 길이)
+ */
+int http_add_conditional(char *req, int n, size_t cap, char *cond)
+{
+  char *p = req, *eol;
+  int m = 0;
+  size_t clen = strlen(cond), linelen;
+  char *out = Malloc(cap);
+
+  while ((eol = strstr(p, "\r\n")) && eol != p && eol < req + n)
+  {
+    linelen = eol - p + 2;
+    if (!http_is_conditional(p))
+    {
+      memcpy(out + m, p, linelen);
+      m += linelen;
+    }
+    p = eol + 2;
+  }
+  if (m + clen + 3 > cap)
+  {
+    free(out);
+    return n;
+  }
+  memcpy(out + m, cond, clen);
+  m += clen;
+  memcpy(out + m, "\r\n", 3);
+  memcpy(req, out, m + 3);
+  free(out);
+  return m + 2;
+}
+
+/**
+ * http_updatable 함수: 304 응답의 헤더 줄이 저장된 헤더를 갱신할 수 있는지 확인합니다.
+ * 본문의 길이와 연결에 관한 헤더는 저장된 것을 유지합니다 (RFC 9111 3.2).
+ */
+static int http_updatable(char *line)
+{
+  static const char *keep[] = {"Content-Length:", "Connection:", "Proxy-Connection:", "Keep-Alive:",
+                               "Transfer-Encoding:", "Content-Encoding:", NULL};
+  int i;
+
+  for (i = 0; keep[i]; i++)
+    if (!strncasecmp(line, keep[i], strlen(keep[i])))
+      return 0;
+  return 1;
+}
+
+/**
+ * http_has_name 함수: 헤더 블록에 line과 같은 이름의 필드가 있는지 확인합니다.
+ */
+static int http_has_name(char *hdr, char *line)
+{
+  char name[MAXLINE], *colon = strchr(line, ':'), *pos = hdr;
+  size_t len;
+
+  if (!colon || colon - line >= MAXLINE)
+    return 0;
+  memcpy(name, line, colon - line);
+  name[colon - line] = '\0';
+  return http_field(&pos, name, &len) != NULL;
+}
+
+/**
+ * http_refresh 함수: 304 응답으로 재검증된 객체의 헤더를 갱신한 새 객체를 만듭니다.
+ * 저장된 헤더 중 304에 같은 이름이 있는 필드는 304의 것으로 바꾸고, 본문은 그대로 씁니다.
+ * stale: 재검증한 캐시 객체 (참조를 가진 상태)
+ * hdr304: NUL로 끝나는 304 응답의 상태 줄과 헤더
+ * reqflags, request_time, response_time: http_storable과 같음
+ * storable: 새 객체를 캐시에 저장해도 되면 1
+ * 반환: 새 객체 (write_cache 또는 free_cache_object로 넘김), 헤더가 너무 길거나 본문을 읽지 못하면 NULL
+ */
+web_object_t *http_refresh(web_object_t *stale, char *hdr304, int reqflags,
+                           time_t request_time, time_t response_time, int *storable)
+{
+  char merged[MAXLINE + 1], *hdr = cache_header(stale), *p, *eol;
+  size_t n;
+  web_object_t *fresh;
+
+  // 상태 줄은 저장된 것을 그대로 씀
+  eol = strstr(hdr, "\r\n");
+  n = eol - hdr + 2;
+  memcpy(merged, hdr, n);
+
+  // 304에 같은 이름이 없는 저장된 필드
+  for (p = eol + 2; (eol = strstr(p, "\r\n")) && eol != p; p = eol + 2)
+  {
+    if (http_updatable(p) && http_has_name(hdr304, p))
+      continue;
+    if (n + (eol - p + 2) + 2 > MAXLINE)
+      return NULL;
+    memcpy(merged + n, p, eol - p + 2);
+    n += eol - p + 2;
+  }
+
+  // 304의 필드
+  for (p = strstr(hdr304, "\r\n") + 2; (eol = strstr(p, "\r\n")) && eol != p; p = eol + 2)
+  {
+    if (!http_updatable(p))
+      continue;
+    if (n + (eol - p + 2) + 2 > MAXLINE)
+      return NULL;
+    memcpy(merged + n, p, eol - p + 2);
+    n += eol - p + 2;
+  }
+  memcpy(merged + n, "\r\n", 3);
+  n += 2;
+
+  if (!(fresh = clone_cache_object(stale, merged, n)))
+    return NULL; // 캐시된 본문을 읽지 못함, 호출자는 원래 객체를 그대로 씀
+  *storable = http_storable(stale->path, reqflags, merged, request_time, response_time, &fresh->expires);
+  return fresh;
+}
+
+/**
+ * http_connection_option 함수: line의 필드 이름이 헤더 블록의 Connection 필드에 적혀 있는지 확인합니다.
+ * Connection에 적힌 이름의 필드는 그 연결에만 의미가 있습니다 (RFC 9110 7.6.1).
+ */
+static int http_connection_option(char *hdr, char *line)
+{
+  char *colon = strchr(line, ':'), *pos = hdr, *v, *end, *tok;
+  size_t len, nlen, tlen, toklen;
+
+  if (!colon)
+    return 0;
+  nlen = colon - line;
+  while ((v = http_field(&pos, "Connection", &len)))
+  {
+    for (end = v + len; v < end; v = tok + tlen + 1)
+    {
+      for (tok = v; tok < end && (*tok == ' ' || *tok == '\t'); tok++)
+        ;
+      for (tlen = 0; tok + tlen < end && tok[tlen] != ','; tlen++)
+        ;
+      for (toklen = tlen; toklen > 0 && (tok[toklen - 1] == ' ' || tok[toklen - 1] == '\t'); toklen--)
+        ;
+      if (toklen == nlen && !strncasecmp(tok, line, nlen))
+        return 1;
+    }
+  }
+  return 0;
+}
+
+/**
+ * http_end_to_end 함수: 응답 헤더에서 연결 하나에만 의미가 있는 홉별 필드(Connection, Keep-Alive,
+ * Proxy-Connection, TE, Trailer, Transfer-Encoding, Upgrade와 Connection에 적힌 이름의 필드)를
+ * 빼고 out에 복사합니다 (RFC 9110 7.6.1). 저장하거나 함께 기다리는 미스들에게 나누는 헤더는
+ * 클라이언트 연결과 관계없어야 하며, Connection 필드와 본문의 전송 방식(send_header의 chunked)은
+ * 보낼 때 연결마다 정합니다.
+ * content_length가 0 이상이고 Content-Length 필드가 없으면 (연결이 끝날 때까지 받은 본문) 채워 넣습니다.
+ * out, cap: 결과를 NUL 종료로 쓸 버퍼와 그 크기
+ * hdr: NUL로 끝나는 응답 상태 줄과 헤더
+ * 반환: 결과의 길이, cap에 들어가지 않으면 0
+ */
+size_t http_end_to_end(char *out, size_t cap, char *hdr, int content_length)
+{
+  static const char *hop[] = {"Connection:", "Keep-Alive:", "Proxy-Connection:", "TE:", "Trailer:",
+                              "Transfer-Encoding:", "Upgrade:", NULL};
+  char length[32], *p, *eol;
+  size_t n = 0, linelen;
+  int i, has_length = 0;
+
+  for (p = hdr; (eol = strstr(p, "\r\n")) && eol != p; p = eol + 2)
+  {
+    for (i = 0; hop[i] && strncasecmp(p, hop[i], strlen(hop[i])); i++)
+      ;
+    if (hop[i] || http_connection_option(hdr, p))
+      continue;
+    has_length |= !strncasecmp(p, "Content-Length:", strlen("Content-Length:"));
+    linelen = eol - p + 2;
+    if (n + linelen >= cap)
+      return 0;
+    memcpy(out + n, p, linelen);
+    n += linelen;
+  }
+  if (!has_length && content_length >= 0)
+  {
+    linelen = sprintf(length, "Content-Length: %d\r\n", content_length);
+    if (n + linelen >= cap)
+      return 0;
+    memcpy(out + n, length, linelen);
+    n += linelen;
+  }
+  if (n + 3 > cap)
+    return 0;
+  memcpy(out + n, "\r\n", 3);
+  return n + 2;
+}
@@ -0,0 +1,538 @@
+#include "cache.h"
+
+/*
+ * policy.c - 캐시 교체 정책
+ *
+ * 캐시(cache.c)는 객체의 순서를 직접 다루지 않고 cache_policy_t의 함수들을 부릅니다.
+ * hit는 락 없이 적중 경로에서 불리고, 나머지는 스트라이프 락을 잡은 상태에서 불립니다.
+ *
+ *   lru    - 적중한 객체를 리스트 앞으로 옮김. 옮기기는 승격 버퍼에 모았다가 락을 잡을 때 반영
+ *   clock  - 적중하면 참조 비트만 켬. 내보낼 때 비트가 켜진 객체는 비트를 끄고 한 번 더 기회를 줌
+ *   s3fifo - 작은 FIFO(10%)에서 한 번도 다시 쓰이지 않은 객체를 빨리 내보내고, 다시 쓰인 객체는
+ *            메인 FIFO로 올림. 작은 큐에서 내보낸 키는 유령 큐에 남겨 곧 다시 오면 바로 메인으로
+ *   gdsf   - GreedyDual-Size-Frequency. 우선순위 L + 빈도 / 크기가 가장 낮은 객체를 내보내므로
+ *            작고 자주 쓰이는 객체가 오래 남음. 적중은 빈도만 올리고 우선순위는 내보낼 때 다시 계산
+ */
+
+#define S3_SMALL 1         // S3-FIFO: 작은 큐에 있음
+#define S3_MAIN 2          // S3-FIFO: 메인 큐에 있음
+#define S3_MAX_FREQ 3      // S3-FIFO 빈도 상한
+#define S3_GHOST_SIZE 1024 // S3-FIFO 유령 큐 크기 (키 해시 수)
+
+/**
+ * list_unlink 함수: 객체를 리스트(head가 가장 최근, tail이 가장 오래된 쪽)에서 떼어냅니다.
+ */
+static void list_unlink(web_object_t **head, web_object_t **tail, web_object_t *obj)
+{
+  if (obj->prev)
+    obj->prev->next = obj->next;
+  else
+    *head = obj->next;
+  if (obj->next)
+    obj->next->prev = obj->prev;
+  else
+    *tail = obj->prev;
+}
+
+/**
+ * list_push 함수: 객체를 리스트의 가장 앞에 연결합니다.
+ */
+static void list_push(web_object_t **head, web_object_t **tail, web_object_t *obj)
+{
+  obj->prev = NULL;
+  obj->next = *head;
+  if (*head)
+    (*head)->prev = obj;
+  else
+    *tail = obj;
+  *head = obj;
+}
+
+/**
+ * list_next_ref 함수: obj부터 리스트 앞쪽으로 가며 빈도(참조 비트)가 켜졌는지가 ref와 같은 첫 객체를 찾습니다.
+ */
+static web_object_t *list_next_ref(web_object_t *obj, int ref)
+{
+  for (; obj; obj = obj->prev)
+    if ((__atomic_load_n(&obj->freq, __ATOMIC_RELAXED) != 0) == ref)
+      return obj;
+  return NULL;
+}
+
+/* LRU */
+
+static void lru_init(cache_shard_t *shard)
+{
+  shard->npromote = 0;
+  memset(shard->promote, 0, sizeof(shard->promote));
+}
+
+/**
+ * lru_flush 함수: 승격 버퍼에 쌓인 객체들을 리스트의 앞으로 옮기고 버퍼의 참조를 놓습니다.
+ * 이미 캐시에서 빠진 객체는 참조만 놓습니다.
+ */
+static void lru_flush(cache_shard_t *shard)
+{
+  web_object_t *obj;
+  int i;
+
+  __atomic_store_n(&shard->npromote, 0, __ATOMIC_RELAXED);
+  for (i = 0; i < CACHE_PROMOTE_BATCH; i++)
+  {
+    if (!__atomic_load_n(&shard->promote[i], __ATOMIC_RELAXED) ||
+        !(obj = __atomic_exchange_n(&shard->promote[i], NULL, __ATOMIC_ACQUIRE)))
+      continue;
+    if (obj->cached && obj != shard->rootp)
+    {
+      list_unlink(&shard->rootp, &shard->lastp, obj);
+      list_push(&shard->rootp, &shard->lastp, obj);
+    }
+    __atomic_store_n(&obj->promote_pending, 0, __ATOMIC_RELAXED);
+    release_cache(obj);
+  }
+}
+
+/**
+ * lru_hit 함수: 적중한 객체를 승격 버퍼에 적어 둡니다 (호출자가 참조를 가진 상태).
+ * 이미 버퍼에 있는 객체는 다시 적지 않으므로, 자주 적중하는 객체도 버퍼 쓰기는 한 번뿐입니다.
+ * 버퍼가 가득 차면 승격을 버리고, 마지막 자리를 채운 스레드는 락이 비어 있을 때만 버퍼를 비웁니다.
+ */
+static void lru_hit(cache_shard_t *shard, web_object_t *obj)
+{
+  web_object_t *old;
+  unsigned slot;
+
+  if (__atomic_load_n(&obj->promote_pending, __ATOMIC_RELAXED) ||
+      __atomic_exchange_n(&obj->promote_pending, 1, __ATOMIC_RELAXED))
+    return;
+
+  slot = __atomic_fetch_add(&shard->npromote, 1, __ATOMIC_RELAXED);
+  if (slot >= CACHE_PROMOTE_BATCH)
+  {
+    __atomic_store_n(&obj->promote_pending, 0, __ATOMIC_RELAXED);
+    return;
+  }
+
+  __atomic_fetch_add(&obj->refcnt, 1, __ATOMIC_RELAXED); // 버퍼의 참조
+  old = __atomic_exchange_n(&shard->promote[slot], obj, __ATOMIC_ACQ_REL);
+  if (old) // 비우는 도중 자리가 재사용되어 덮어쓴 승격은 버림
+  {
+    __atomic_store_n(&old->promote_pending, 0, __ATOMIC_RELAXED);
+    release_cache(old);
+  }
+
+  if (slot == CACHE_PROMOTE_BATCH - 1 && pthread_mutex_trylock(&shard->lock) == 0)
+  {
+    lru_flush(shard);
+    pthread_mutex_unlock(&shard->lock);
+  }
+}
+
+static void lru_insert(cache_shard_t *shard, web_object_t *obj)
+{
+  list_push(&shard->rootp, &shard->lastp, obj);
+}
+
+static web_object_t *lru_victim(cache_shard_t *shard)
+{
+  return shard->lastp;
+}
+
+static web_object_t *lru_peek(cache_shard_t *shard, web_object_t *prev)
+{
+  return prev ? prev->prev : shard->lastp;
+}
+
+static void lru_remove(cache_shard_t *shard, web_object_t *obj)
+{
+  list_unlink(&shard->rootp, &shard->lastp, obj);
+}
+
+/* CLOCK: 리스트를 원형 버퍼처럼 써서, 비트가 켜진 꼬리 객체를 앞으로 옮기는 것이 바늘을 돌리는 것 */
+
+static void clock_hit(cache_shard_t *shard, web_object_t *obj)
+{
+  if (!__atomic_load_n(&obj->freq, __ATOMIC_RELAXED))
+    __atomic_store_n(&obj->freq, 1, __ATOMIC_RELAXED);
+}
+
+static web_object_t *clock_victim(cache_shard_t *shard)
+{
+  web_object_t *obj;
+
+  while ((obj = shard->lastp) && __atomic_load_n(&obj->freq, __ATOMIC_RELAXED))
+  {
+    __atomic_store_n(&obj->freq, 0, __ATOMIC_RELAXED);
+    list_unlink(&shard->rootp, &shard->lastp, obj);
+    list_push(&shard->rootp, &shard->lastp, obj);
+  }
+  return obj;
+}
+
+/**
+ * clock_peek 함수: 바늘이 한 바퀴 돌며 비트가 꺼진 객체들을 먼저 내보내고, 비트를 끈 객체들을
+ * 다음 바퀴에 내보내는 순서를 그대로 따라갑니다.
+ */
+static web_object_t *clock_peek(cache_shard_t *shard, web_object_t *prev)
+{
+  int ref = prev && __atomic_load_n(&prev->freq, __ATOMIC_RELAXED);
+  web_object_t *obj = list_next_ref(prev ? prev->prev : shard->lastp, ref);
+
+  if (!obj && !ref)
+    obj = list_next_ref(shard->lastp, 1);
+  return obj;
+}
+
+/* S3-FIFO: 메인 큐는 스트라이프의 rootp/lastp, 작은 큐와 유령 큐는 s3fifo_t */
+
+/**
+ * s3fifo_t 구조체: S3-FIFO 정책의 스트라이프별 상태입니다.
+ * small_head, small_tail, small_size: 작은 큐와 그 크기 (alloc_size 합)
+ * ghost, ghost_pos: 작은 큐에서 내보낸 키의 해시를 담는 원형 버퍼와 다음에 쓸 자리
+ */
+typedef struct s3fifo_t
+{
+  web_object_t *small_head, *small_tail;
+  size_t small_size;
+  uint64_t ghost[S3_GHOST_SIZE];
+  int ghost_pos;
+} s3fifo_t;
+
+static void s3fifo_init(cache_shard_t *shard)
+{
+  shard->policy_state = Calloc(1, sizeof(s3fifo_t));
+}
+
+static void s3fifo_fini(cache_shard_t *shard)
+{
+  free(shard->policy_state);
+}
+
+static void s3fifo_hit(cache_shard_t *shard, web_object_t *obj)
+{
+  uint8_t f = __atomic_load_n(&obj->freq, __ATOMIC_RELAXED);
+  if (f < S3_MAX_FREQ)
+    __atomic_store_n(&obj->freq, f + 1, __ATOMIC_RELAXED);
+}
+
+static int s3fifo_ghost_has(s3fifo_t *s, uint64_t hash)
+{
+  int i;
+
+  for (i = 0; i < S3_GHOST_SIZE; i++)
+    if (s->ghost[i] == hash)
+      return 1;
+  return 0;
+}
+
+static void s3fifo_insert(cache_shard_t *shard, web_object_t *obj)
+{
+  s3fifo_t *s = shard->policy_state;
+
+  if (s3fifo_ghost_has(s, obj->hash))
+  {
+    obj->qtag = S3_MAIN;
+    list_push(&shard->rootp, &shard->lastp, obj);
+  }
+  else
+  {
+    obj->qtag = S3_SMALL;
+    list_push(&s->small_head, &s->small_tail, obj);
+    s->small_size += obj->alloc_size;
+  }
+}
+
+/**
+ * s3fifo_victim 함수: 작은 큐가 몫(10%)을 넘었거나 메인 큐가 비었으면 작은 큐에서, 아니면
+ * 메인 큐에서 내보낼 객체를 고릅니다. 작은 큐에서 다시 쓰인 객체는 메인 큐로 올리고,
+ * 메인 큐에서 다시 쓰인 객체는 빈도를 하나 줄여 앞으로 돌려보냅니다.
+ */
+static web_object_t *s3fifo_victim(cache_shard_t *shard)
+{
+  s3fifo_t *s = shard->policy_state;
+  web_object_t *obj;
+
+  while (1)
+  {
+    if (s->small_tail && (s->small_size > shard->max_cache_size / 10 || !shard->lastp))
+    {
+      obj = s->small_tail;
+      if (!__atomic_load_n(&obj->freq, __ATOMIC_RELAXED))
+      {
+        s->ghost[s->ghost_pos] = obj->hash;
+        s->ghost_pos = (s->ghost_pos + 1) % S3_GHOST_SIZE;
+        return obj;
+      }
+      list_unlink(&s->small_head, &s->small_tail, obj);
+      s->small_size -= obj->alloc_size;
+      __atomic_store_n(&obj->freq, 0, __ATOMIC_RELAXED);
+      obj->qtag = S3_MAIN;
+      list_push(&shard->rootp, &shard->lastp, obj);
+    }
+    else if ((obj = shard->lastp))
+    {
+      uint8_t f = __atomic_load_n(&obj->freq, __ATOMIC_RELAXED);
+      if (!f)
+        return obj;
+      __atomic_store_n(&obj->freq, f - 1, __ATOMIC_RELAXED);
+      list_unlink(&shard->rootp, &shard->lastp, obj);
+      list_push(&shard->rootp, &shard->lastp, obj);
+    }
+    else
+      return NULL;
+  }
+}
+
+/**
+ * s3fifo_peek 함수: 다시 쓰이지 않은 객체를 작은 큐, 메인 큐 순서로 먼저 내놓고,
+ * 다시 쓰인 객체를 같은 순서로 그 뒤에 내놓습니다 (작은 큐의 몫은 따지지 않는 추정).
+ */
+static web_object_t *s3fifo_peek(cache_shard_t *shard, web_object_t *prev)
+{
+  s3fifo_t *s = shard->policy_state;
+  web_object_t *obj;
+  int step = 0; // 0: 작은 큐, 1: 메인 큐, 2와 3: 다시 쓰인 객체로 같은 순서
+
+  if (prev)
+  {
+    step = (__atomic_load_n(&prev->freq, __ATOMIC_RELAXED) ? 2 : 0) + (prev->qtag == S3_MAIN);
+    if ((obj = list_next_ref(prev->prev, step >= 2)))
+      return obj;
+    step++;
+  }
+  for (; step < 4; step++)
+    if ((obj = list_next_ref(step % 2 ? shard->lastp : s->small_tail, step >= 2)))
+      return obj;
+  return NULL;
+}
+
+static void s3fifo_remove(cache_shard_t *shard, web_object_t *obj)
+{
+  s3fifo_t *s = shard->policy_state;
+
+  if (obj->qtag == S3_SMALL)
+  {
+    list_unlink(&s->small_head, &s->small_tail, obj);
+    s->small_size -= obj->alloc_size;
+  }
+  else
+    list_unlink(&shard->rootp, &shard->lastp, obj);
+}
+
+/* GDSF: 우선순위가 가장 낮은 객체가 맨 위에 오는 이진 힙 */
+
+/**
+ * gdsf_node_t 구조체: 힙의 한 자리입니다. 비교할 때 객체를 따라가지 않도록 우선순위를 함께 둡니다.
+ */
+typedef struct gdsf_node_t
+{
+  double prio;
+  web_object_t *obj;
+} gdsf_node_t;
+
+/**
+ * gdsf_t 구조체: GDSF 정책의 스트라이프별 상태입니다.
+ * heap, n, cap: 우선순위 최소 힙 (객체의 heap_idx가 자기 자리를 가리킴)
+ * clock: 마지막으로 내보낸 객체의 우선순위 (L, 새 우선순위의 기준값)
+ */
+typedef struct gdsf_t
+{
+  gdsf_node_t *heap;
+  size_t n, cap;
+  double clock;
+} gdsf_t;
+
+static void gdsf_init(cache_shard_t *shard)
+{
+  gdsf_t *g = Calloc(1, sizeof(gdsf_t));
+
+  g->cap = 64;
+  g->heap = Malloc(g->cap * sizeof(gdsf_node_t));
+  shard->policy_state = g;
+}
+
+static void gdsf_fini(cache_shard_t *shard)
+{
+  gdsf_t *g = shard->policy_state;
+
+  free(g->heap);
+  free(g);
+}
+
+/**
+ * gdsf_priority 함수: 빈도 freq인 객체의 우선순위 L + (freq + 1) / 크기를 계산합니다.
+ * (크기는 KB 단위로 써서 값의 범위를 적당히 유지)
+ */
+static double gdsf_priority(gdsf_t *g, web_object_t *obj, int freq)
+{
+  return g->clock + (freq + 1) * 1024.0 / obj->alloc_size;
+}
+
+static void gdsf_set(gdsf_t *g, size_t i, gdsf_node_t node)
+{
+  g->heap[i] = node;
+  node.obj->heap_idx = i;
+}
+
+static void gdsf_up(gdsf_t *g, size_t i)
+{
+  gdsf_node_t node = g->heap[i];
+
+  while (i > 0 && g->heap[(i - 1) / 2].prio > node.prio)
+  {
+    gdsf_set(g, i, g->heap[(i - 1) / 2]);
+    i = (i - 1) / 2;
+  }
+  gdsf_set(g, i, node);
+}
+
+static void gdsf_down(gdsf_t *g, size_t i)
+{
+  gdsf_node_t node = g->heap[i];
+  size_t c;
+
+  while ((c = 2 * i + 1) < g->n)
+  {
+    if (c + 1 < g->n && g->heap[c + 1].prio < g->heap[c].prio)
+      c++;
+    if (g->heap[c].prio >= node.prio)
+      break;
+    gdsf_set(g, i, g->heap[c]);
+    i = c;
+  }
+  gdsf_set(g, i, node);
+}
+
+static void gdsf_hit(cache_shard_t *shard, web_object_t *obj)
+{
+  uint8_t f = __atomic_load_n(&obj->freq, __ATOMIC_RELAXED);
+  if (f < UINT8_MAX)
+    __atomic_store_n(&obj->freq, f + 1, __ATOMIC_RELAXED);
+}
+
+static void gdsf_insert(cache_shard_t *shard, web_object_t *obj)
+{
+  gdsf_t *g = shard->policy_state;
+
+  if (g->n == g->cap)
+  {
+    g->cap *= 2;
+    g->heap = Realloc(g->heap, g->cap * sizeof(gdsf_node_t));
+  }
+  obj->qtag = 0; // 우선순위를 계산할 때의 빈도
+  g->heap[g->n].prio = gdsf_priority(g, obj, 0);
+  g->heap[g->n].obj = obj;
+  gdsf_up(g, g->n++);
+}
+
+/**
+ * gdsf_victim 함수: 우선순위가 가장 낮은 객체를 고릅니다.
+ * 맨 위 객체가 마지막 계산 뒤에 적중했으면 우선순위를 다시 계산해 가라앉히고 다시 봅니다.
+ */
+static web_object_t *gdsf_victim(cache_shard_t *shard)
+{
+  gdsf_t *g = shard->policy_state;
+  web_object_t *obj;
+  uint8_t f;
+
+  while (g->n > 0)
+  {
+    obj = g->heap[0].obj;
+    f = __atomic_load_n(&obj->freq, __ATOMIC_RELAXED);
+    if (f == obj->qtag)
+    {
+      g->clock = g->heap[0].prio;
+      return obj;
+    }
+    obj->qtag = f;
+    g->heap[0].prio = gdsf_priority(g, obj, f);
+    gdsf_down(g, 0);
+  }
+  return NULL;
+}
+
+/**
+ * gdsf_prio 함수: gdsf_victim이 다시 계산할 우선순위를 힙을 건드리지 않고 구합니다.
+ */
+static double gdsf_prio(gdsf_t *g, size_t i)
+{
+  web_object_t *obj = g->heap[i].obj;
+  uint8_t f = __atomic_load_n(&obj->freq, __ATOMIC_RELAXED);
+
+  return f == obj->qtag ? g->heap[i].prio : gdsf_priority(g, obj, f);
+}
+
+/**
+ * gdsf_peek_at 함수: i를 뿌리로 하는 부분 힙에서 (lo, prev)보다 뒤인 가장 낮은 우선순위의 객체를 찾아
+ * best에 둡니다. 다시 계산한 우선순위는 힙에 적힌 값보다 낮아지지 않으므로, 적힌 값이 이미 찾은
+ * 것보다 높은 부분 힙은 건너뜁니다.
+ */
+static void gdsf_peek_at(gdsf_t *g, size_t i, web_object_t *prev, double lo,
+                         web_object_t **best, double *best_prio)
+{
+  web_object_t *obj;
+  double prio;
+
+  if (i >= g->n || (*best && g->heap[i].prio > *best_prio))
+    return;
+  obj = g->heap[i].obj;
+  prio = gdsf_prio(g, i);
+  if ((!prev || prio > lo || (prio == lo && obj > prev)) &&
+      (!*best || prio < *best_prio || (prio == *best_prio && obj < *best)))
+  {
+    *best = obj;
+    *best_prio = prio;
+  }
+  gdsf_peek_at(g, 2 * i + 1, prev, lo, best, best_prio);
+  gdsf_peek_at(g, 2 * i + 2, prev, lo, best, best_prio);
+}
+
+/**
+ * gdsf_peek 함수: prev 다음으로 우선순위가 낮은 객체를 찾습니다.
+ * 우선순위가 같으면 주소로 순서를 정해 같은 객체를 두 번 내놓지 않습니다.
+ */
+static web_object_t *gdsf_peek(cache_shard_t *shard, web_object_t *prev)
+{
+  gdsf_t *g = shard->policy_state;
+  web_object_t *best = NULL;
+  double best_prio = 0;
+
+  gdsf_peek_at(g, 0, prev, prev ? gdsf_prio(g, prev->heap_idx) : 0, &best, &best_prio);
+  return best;
+}
+
+static void gdsf_remove(cache_shard_t *shard, web_object_t *obj)
+{
+  gdsf_t *g = shard->policy_state;
+  size_t i = obj->heap_idx;
+  web_object_t *last;
+
+  if (--g->n == i)
+    return;
+  // 마지막 객체를 빈자리로 옮긴 뒤 아래나 위로 자리를 찾아 줌
+  last = g->heap[g->n].obj;
+  gdsf_set(g, i, g->heap[g->n]);
+  gdsf_down(g, i);
+  gdsf_up(g, last->heap_idx);
+}
+
+const cache_policy_t lru_policy = {"lru", lru_init, lru_flush, lru_hit, lru_insert, lru_victim, lru_peek, lru_remove, lru_flush};
+const cache_policy_t clock_policy = {"clock", NULL, NULL, clock_hit, lru_insert, clock_victim, clock_peek, lru_remove, NULL};
+const cache_policy_t s3fifo_policy = {"s3fifo", s3fifo_init, NULL, s3fifo_hit, s3fifo_insert, s3fifo_victim, s3fifo_peek, s3fifo_remove, s3fifo_fini};
+const cache_policy_t gdsf_policy = {"gdsf", gdsf_init, NULL, gdsf_hit, gdsf_insert, gdsf_victim, gdsf_peek, gdsf_remove, gdsf_fini};
+
+const cache_policy_t *cache_policies[] = {&lru_policy, &clock_policy, &s3fifo_policy, &gdsf_policy, NULL};
+
+/**
+ * cache_find_policy 함수: 이름으로 교체 정책을 찾습니다.
+ * 반환: 정책, 없으면 NULL
+ */
+const cache_policy_t *cache_find_policy(const char *name)
+{
+  int i;
+
+  for (i = 0; cache_policies[i]; i++)
+    if (!strcmp(cache_policies[i]->name, name))
+      return cache_policies[i];
+  return NULL;
+}
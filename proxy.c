@@ -1,291 +1,924 @@
+#define _GNU_SOURCE
 #include <stdio.h>
-#include "csapp.h"
+#include <sys/eventfd.h>
+#include "proxy.h"
+#include "sbuf.h"
+#include "slab.h"
+
+// 함수 선언
+void *thread(void *vargp);
+void *worker(void *vargp);
+void reject_busy(int clientfd);
+int accept_batch(int listenfd, int *fds, int max);
+void clienterror(int fd, char *cause, char *errnum, char *shortmsg, char *longmsg);
+static int follow_flight(flight_t *flight, int clientfd, int keepalive);
+static void end_flight(flight_t *flight);
+static int upstream_send(char *hostname, char *port, char *req, int n, int pooled, int *reused);
+static int tee_body(char **body, int *body_len, char *data, size_t n);
 
 /**
- * web_object_t 구조체: 웹 캐시에 저장되는 객체의 정보를 저장합니다.
- * path: 객체의 URI 경로
- * content_length: 객체의 콘텐츠 길이
- * response_ptr: 객체 콘텐츠를 가리키는 포인터
- * prev, next: 이중 연결 리스트에서의 이전 및 다음 객체를 가리키는 포인터
+ * main 함수: 웹 프록시 서버의 메인 함수입니다.
+ * 이 함수는 서버의 리스닝 소켓을 설정하고, 클라이언트의 연결 요청을 지속적으로 수락합니다.
+ * 기본(thread) 모드에서는 각 클라이언트 연결이 별도의 스레드에서 처리되고,
+ * pool 모드에서는 미리 만들어 둔 워커 스레드들이 유한 크기 연결 큐(sbuf)에서 연결을 꺼내 처리하며,
+ * epoll 모드에서는 코어 수만큼의 이벤트 루프 스레드가 논블로킹 연결들을 다중화하고,
+ * shard 모드에서는 샤드마다 SO_REUSEPORT 리스닝 소켓, 이벤트 루프, 캐시 파티션을 따로 두며,
+ * uring 모드에서는 io_uring으로 accept/read/write/connect를 모아 제출하고,
+ * coro 모드에서는 연결마다 작은 스택의 코루틴에서 doit를 실행하며 I/O 대기 시 양보합니다.
+ *
+ * argc: 명령줄 인자의 개수
+ * argv: 명령줄 인자의 배열
+ *       ([-m thread|pool|epoll|shard|uring|coro] [-n 스레드 수] [-q 큐 크기] [-s 스택 KB] [-r] [-b] [-H]
+ *        [-e lru|clock|s3fifo|gdsf] [-z] <port>)
+ *       -r: pool 모드에서 큐가 가득 차면 accept를 막는 대신 즉시 503으로 거절
+ *       -b: shard 모드에서 CBPF 프로그램으로 클라이언트 주소마다 샤드를 고정
+ *       -H: 캐시 슬랩 아레나를 huge page(MAP_HUGETLB, 안 되면 THP)로 받음
+ *       -e: 캐시 교체 정책 (기본값 lru)
+ *       -z: 큰 캐시 본문을 memfd에 두고 적중하면 sendfile로 보냄 (thread, pool, coro 모드)
  */
-typedef struct web_object_t
-{
-  char path[MAXLINE];                 
-  int content_length;                 
-  char *response_ptr;                 
-  struct web_object_t *prev, *next;   
-} web_object_t;
-
-// 함수 선언
-web_object_t *find_cache(char *path);
-void send_cache(web_object_t *web_object, int clientfd);
-void read_cache(web_object_t *web_object);
-void write_cache(web_object_t *web_object);
+static const int is_local_test = 1; 
+static const char *user_agent_hdr =
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:10.0.3) Gecko/20120305 "
+    "Firefox/10.0.3\r\n";
 
-// 전역 변수 선언
-extern web_object_t *rootp;           // 캐시된 객체의 루트 포인터
-extern web_object_t *lastp;           // 캐시된 객체의 마지막 포인터
-extern int total_cache_size;          // 현재 캐시의 총 크기
+static sbuf_t sbuf; // pool 모드의 연결 큐
 
-// 캐시 크기 상수 정의
-#define MAX_CACHE_SIZE 1049000
-#define MAX_OBJECT_SIZE 102400
+#define ACCEPT_BATCH 64 // accept 스레드가 한 번에 수락할 최대 연결 수
 
-// 전역 변수 초기화
-web_object_t *rootp;
-web_object_t *lastp;
-int total_cache_size = 0;
+// pool 모드 기본값
+#define POOL_NTHREADS 16
+#define POOL_SBUFSIZE 64
 
-/**
- * find_cache 함수: 주어진 경로와 일치하는 캐시된 객체를 찾습니다.
- * path: 찾을 객체의 경로
- * 반환: 찾은 객체의 포인터, 없으면 NULL 반환
- */
-web_object_t *find_cache(char *path)
+static void usage(char *prog)
 {
-  if (!rootp) 
-    return NULL;
-  web_object_t *current = rootp;      
-  while (strcmp(current->path, path)) 
-  {
-    if (!current->next) 
-      return NULL;
-
-    current = current->next;          
-    if (!strcmp(current->path, path)) 
-      return current;
-  }
-  return current;
+  fprintf(stderr, "usage: %s [-m thread|pool|epoll|shard|uring|coro] [-n threads] [-q slots] [-s stack_kb] [-r] [-b] [-H] [-e lru|clock|s3fifo|gdsf] [-z] <port>\n", prog);
+  exit(1);
 }
 
-/**
- * send_cache 함수: 캐시된 객체를 클라이언트에게 전송합니다.
- * web_object: 전송할 캐시된 객체의 포인터
- * clientfd: 클라이언트 소켓의 파일 디스크립터
- */
-void send_cache(web_object_t *web_object, int clientfd)
+int main(int argc, char **argv)
 {
-  char buf[MAXLINE];
-  sprintf(buf, "HTTP/1.0 200 OK\r\n");                                      
-  sprintf(buf, "%sServer: Tiny Web Server\r\n", buf);                            
-  sprintf(buf, "%sConnection: close\r\n", buf);                                  
-  sprintf(buf, "%sContent-length: %d\r\n\r\n", buf, web_object->content_length); 
-  Rio_writen(clientfd, buf, strlen(buf));
+  int listenfd, clientfds[ACCEPT_BATCH], nfds; // 리스닝 소켓 및 한 번에 수락한 클라이언트 소켓들
+  pthread_t tid; // 스레드 ID
+  char *mode = "thread"; // 동시성 모드
+  int nthreads = 0, opt; // 이벤트 루프 또는 워커 스레드 수 (0이면 모드별 기본값)
+  int nslots = POOL_SBUFSIZE, stack_kb = 0, reject = 0; // pool 모드 설정 (stack_kb는 coro 모드도 사용)
+  int steer = 0; // shard 모드 설정
+  int huge = 0; // 캐시 슬랩을 huge page로 받을지 여부
+  int memfd = 0; // 큰 캐시 본문을 memfd에 둘지 여부
+  const cache_policy_t *policy = &lru_policy; // 캐시 교체 정책
+  pthread_attr_t attr; // 워커 스레드 속성 (스택 크기)
+  int i;
+  signal(SIGPIPE, SIG_IGN); // SIGPIPE 시그널을 무시하도록 설정
 
-  Rio_writen(clientfd, web_object->response_ptr, web_object->content_length);
-}
+  // 명령줄 옵션을 해석하고, 포트 번호가 제공되지 않았다면 사용법을 출력하고 종료
+  while ((opt = getopt(argc, argv, "m:n:q:s:rbHe:z")) != -1)
+  {
+    if (opt == 'm')
+      mode = optarg;
+    else if (opt == 'n')
+      nthreads = atoi(optarg);
+    else if (opt == 'q')
+      nslots = atoi(optarg);
+    else if (opt == 's')
+      stack_kb = atoi(optarg);
+    else if (opt == 'r')
+      reject = 1;
+    else if (opt == 'b')
+      steer = 1;
+    else if (opt == 'H')
+      huge = 1;
+    else if (opt == 'z')
+      memfd = 1;
+    else if (opt == 'e')
+    {
+      if (!(policy = cache_find_policy(optarg)))
+        usage(argv[0]);
+    }
+    else
+      usage(argv[0]);
+  }
+  if (optind != argc - 1)
+    usage(argv[0]);
 
-/**
- * read_cache 함수: 주어진 객체를 캐시의 가장 앞으로 이동시킵니다.
- * web_object: 최근에 사용된 캐시된 객체의 포인터
- */
-void read_cache(web_object_t *web_object)
-{
-  if (web_object == rootp) 
-    return;
+  // 캐시 메모리(슬랩)와 웹 객체 캐시 초기화
+  slab_init(huge ? SLAB_HUGE : 0);
+  cache_init(&proxy_cache, MAX_CACHE_SIZE, policy);
+  proxy_cache.memfd = memfd;
 
-  if (web_object->next) 
+  // shard 모드는 샤드마다 리스닝 소켓을 직접 엽니다.
+  if (!strcmp(mode, "shard"))
   {
+    if (nthreads <= 0)
+      nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+    event_shard_main(argv[optind], nthreads, steer); // 반환하지 않음
+  }
+
+  // 리스닝 소켓을 설정하고, 지정된 포트에서 클라이언트의 연결을 기다립니다.
+  listenfd = Open_listenfd(argv[optind]); 
 
-    web_object_t *prev_objtect = web_object->prev;
-    web_object_t *next_objtect = web_object->next;
-    if (prev_objtect)
-      web_object->prev->next = next_objtect;
-    web_object->next->prev = prev_objtect;
+  if (!strcmp(mode, "uring"))
+  {
+    if (nthreads <= 0)
+      nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+    uring_main(listenfd, nthreads); // 성공하면 반환하지 않음
+    fprintf(stderr, "io_uring is not available (%s), falling back to epoll\n", strerror(errno));
+    event_main(listenfd, nthreads);
   }
-  else 
+  else if (!strcmp(mode, "coro"))
   {
-    web_object->prev->next = NULL; 
+    if (nthreads <= 0)
+      nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+    coro_main(listenfd, nthreads, stack_kb); // 반환하지 않음
   }
-
-  web_object->next = rootp; 
-  rootp = web_object;
-}
-
-/**
- * write_cache 함수: 새로운 객체를 캐시에 추가합니다.
- * web_object: 캐시에 추가할 객체의 포인터
- */
-void write_cache(web_object_t *web_object)
-{
-  total_cache_size += web_object->content_length;
-
-  while (total_cache_size > MAX_CACHE_SIZE)
+  else if (!strcmp(mode, "epoll"))
   {
-    total_cache_size -= lastp->content_length;
-    lastp = lastp->prev; 
-    free(lastp->next);   
-    lastp->next = NULL;
+    if (nthreads <= 0)
+      nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+    event_main(listenfd, nthreads); // 반환하지 않음
   }
+  else if (!strcmp(mode, "pool"))
+  {
+    // 연결 큐를 만들고 고정된 수의 워커 스레드를 미리 생성합니다.
+    if (nthreads <= 0)
+      nthreads = POOL_NTHREADS;
+    if (nslots <= 0)
+      usage(argv[0]);
+    sbuf_init(&sbuf, nslots);
+    pthread_attr_init(&attr);
+    if (stack_kb > 0 && pthread_attr_setstacksize(&attr, (size_t)stack_kb * 1024) != 0)
+    {
+      fprintf(stderr, "invalid stack size: %d KB\n", stack_kb);
+      exit(1);
+    }
+    for (i = 0; i < nthreads; i++)
+      Pthread_create(&tid, &attr, worker, NULL);
+    pthread_attr_destroy(&attr);
+  }
+  else if (strcmp(mode, "thread"))
+    usage(argv[0]);
 
-  if (!rootp) 
-    lastp = web_object;
-
-
-  if (rootp)
+  // 리스닝 소켓을 논블로킹으로 바꾸고, 대기 중인 연결을 한 번에 모아 수락한 뒤
+  // 스레드를 생성하거나 큐에 넣는 일을 반복합니다.
+  fcntl(listenfd, F_SETFL, fcntl(listenfd, F_GETFL) | O_NONBLOCK);
+  while (1)
   {
-    web_object->next = rootp;
-    rootp->prev = web_object;
+    nfds = accept_batch(listenfd, clientfds, ACCEPT_BATCH);
+    for (i = 0; i < nfds; i++)
+    {
+      if (!strcmp(mode, "pool"))
+      {
+        if (!reject)
+          sbuf_insert(&sbuf, clientfds[i]); // 큐가 가득 차면 빈 자리가 날 때까지 accept를 멈춤
+        else if (!sbuf_tryinsert(&sbuf, clientfds[i]))
+          reject_busy(clientfds[i]);
+      }
+      else
+        Pthread_create(&tid, NULL, thread, (void *)(intptr_t)clientfds[i]); // fd 값을 포인터에 담아 전달
+    }
   }
-  rootp = web_object;
 }
 
-// 함수 선언
-void *thread(void *vargp);
-void doit(int clientfd);
-void read_requesthdrs(rio_t *rp, void *buf, int serverfd, char *hostname, char *port);
-void clienterror(int fd, char *cause, char *errnum, char *shortmsg, char *longmsg);
-void parse_uri(char *uri, char *hostname, char *port, char *path);
-
 /**
- * main 함수: 웹 프록시 서버의 메인 함수입니다.
- * 이 함수는 서버의 리스닝 소켓을 설정하고, 클라이언트의 연결 요청을 지속적으로 수락합니다.
- * 각 클라이언트 연결은 별도의 스레드에서 처리됩니다.
+ * accept_batch 함수: 리스닝 소켓의 backlog에 쌓인 연결을 최대 max개까지 한 번에 수락합니다.
+ * 수락할 연결이 없으면 리스닝 소켓이 읽기 가능해질 때까지 기다립니다.
+ * 클라이언트 주소는 역방향 DNS 조회 없이 숫자 형태로만 출력합니다.
  *
- * argc: 명령줄 인자의 개수
- * argv: 명령줄 인자의 배열 (argv[1]은 사용할 포트 번호)
+ * listenfd: 논블로킹 리스닝 소켓
+ * fds: 수락한 클라이언트 소켓을 담을 배열
+ * max: 배열의 크기
+ * 반환 값: 수락한 연결의 수 (1 이상)
  */
-static const int is_local_test = 1; 
-static const char *user_agent_hdr =
-    "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:10.0.3) Gecko/20120305 "
-    "Firefox/10.0.3\r\n";
-
-int main(int argc, char **argv)
+int accept_batch(int listenfd, int *fds, int max)
 {
-  int listenfd, *clientfd; // 리스닝 소켓 및 클라이언트 소켓 파일 디스크립터
-  char client_hostname[MAXLINE], client_port[MAXLINE]; // 클라이언트의 호스트 이름과 포트 번호
-  socklen_t clientlen; // 클라이언트 주소 구조체의 크기
   struct sockaddr_storage clientaddr; // 클라이언트 주소 정보를 저장하는 구조체
-  pthread_t tid; // 스레드 ID
-  signal(SIGPIPE, SIG_IGN); // SIGPIPE 시그널을 무시하도록 설정
-
-  // 웹 객체 캐시를 위한 루트 및 마지막 포인터 할당 및 초기화
-  rootp = (web_object_t *)calloc(1, sizeof(web_object_t));
-  lastp = (web_object_t *)calloc(1, sizeof(web_object_t));
+  socklen_t clientlen; // 클라이언트 주소 구조체의 크기
+  char client_hostname[NI_MAXHOST], client_port[NI_MAXSERV]; // 클라이언트의 주소와 포트 번호
+  int n = 0, fd;
 
-  // 명령줄 인자를 확인하고, 포트 번호가 제공되지 않았다면 사용법을 출력하고 종료
-  if (argc != 2)
+  while (n == 0)
   {
-    fprintf(stderr, "usage: %s <port>\n", argv[0]);
-    exit(1);
+    while (n < max)
+    {
+      clientlen = sizeof(clientaddr);
+      fd = accept4(listenfd, (SA *)&clientaddr, &clientlen, SOCK_CLOEXEC);
+      if (fd < 0)
+      {
+        if (errno == EINTR || errno == ECONNABORTED || errno == EPROTO)
+          continue; // 수락 전에 끊긴 연결은 건너뜀
+        if (errno == EMFILE || errno == ENFILE)
+        {
+          fprintf(stderr, "accept error: %s\n", strerror(errno));
+          if (n == 0)
+            usleep(10000); // fd가 반환될 때까지 잠시 쉼 (바쁜 대기 방지)
+        }
+        else if (errno != EAGAIN && errno != EWOULDBLOCK)
+          unix_error("Accept error");
+        break;
+      }
+      if (getnameinfo((SA *)&clientaddr, clientlen, client_hostname, NI_MAXHOST,
+                      client_port, NI_MAXSERV, NI_NUMERICHOST | NI_NUMERICSERV) == 0)
+        printf("Accepted connection from (%s, %s)\n", client_hostname, client_port);
+      fds[n++] = fd;
+    }
+    if (n == 0)
+      rio_wait(listenfd, POLLIN); // backlog가 비었으면 새 연결을 기다림
   }
+  return n;
+}
 
-  // 리스닝 소켓을 설정하고, 지정된 포트에서 클라이언트의 연결을 기다립니다.
-  listenfd = Open_listenfd(argv[1]); 
-
-  // 무한 루프를 통해 지속적으로 클라이언트 연결을 수락하고 스레드를 생성합니다.
+/**
+ * worker 함수: pool 모드의 워커 스레드 함수입니다.
+ * 연결 큐에서 클라이언트 소켓을 꺼내 요청들을 처리하고 연결을 종료하는 일을 반복합니다.
+ * keep-alive 연결이 다음 요청을 기다리는 동안(최대 CLIENT_IDLE_TIMEOUT)은 워커를 차지합니다.
+ *
+ * vargp: 사용하지 않습니다.
+ */
+void *worker(void *vargp)
+{
+  Pthread_detach(pthread_self());
   while (1)
   {
-    clientlen = sizeof(clientaddr);
-    clientfd = Malloc(sizeof(int));
-    *clientfd = Accept(listenfd, (SA *)&clientaddr, &clientlen);
-    Getnameinfo((SA *)&clientaddr, clientlen, client_hostname, MAXLINE, client_port, MAXLINE, 0);
-    printf("Accepted connection from (%s, %s)\n", client_hostname, client_port);
-    Pthread_create(&tid, NULL, thread, clientfd);
+    int clientfd = sbuf_remove(&sbuf); // 큐에서 연결을 꺼냄 (없으면 대기)
+    serve_client(clientfd);
+    Close(clientfd);
   }
 }
 
+/**
+ * reject_busy 함수: 연결 큐가 가득 찼을 때 클라이언트에게 503 응답을 보내고 연결을 닫습니다.
+ * 쓰기 실패는 무시합니다 (accept 스레드가 종료되면 안 되므로).
+ *
+ * clientfd: 거절할 클라이언트 소켓
+ */
+void reject_busy(int clientfd)
+{
+  char buf[MAXLINE + MAXBUF];
+  int n = format_clienterror(buf, "", "503", "Service Unavailable", "Proxy is too busy");
+  rio_writen(clientfd, buf, n);
+  close(clientfd);
+}
+
 /**
  * thread 함수: 새로운 클라이언트 연결을 처리하는 스레드 함수입니다.
  * 이 함수는 스레드를 분리(detach)하고, 클라이언트와의 통신을 처리한 후 연결을 종료합니다.
  *
- * vargp: 클라이언트 소켓 파일 디스크립터를 가리키는 포인터입니다.
+ * vargp: 클라이언트 소켓 파일 디스크립터 값을 담은 포인터입니다 (힙 할당 없이 값으로 전달).
  * 반환 값: NULL을 반환합니다.
  */
 void *thread(void *vargp)
 {
-  int clientfd = *((int *)vargp); // 클라이언트 소켓 파일 디스크립터 추출
+  int clientfd = (int)(intptr_t)vargp; // 클라이언트 소켓 파일 디스크립터 추출
   Pthread_detach(pthread_self()); // 현재 스레드를 분리(detach)하여 독립적으로 실행
-  Free(vargp); // 동적 할당된 메모리 해제
-  doit(clientfd); // 클라이언트 요청 처리
+  serve_client(clientfd); // 클라이언트 요청들 처리
   Close(clientfd); // 클라이언트 소켓 종료
   return NULL;
 }
 
 /**
- * doit 함수: 클라이언트로부터의 HTTP 요청을 처리합니다.
- * 이 함수는 클라이언트의 요청을 읽고, 필요에 따라 캐시된 응답을 전송하거나
- * 원격 서버에 요청을 전달하여 새로운 응답을 가져옵니다.
+ * serve_client 함수: 클라이언트 연결 하나에서 요청을 차례로 처리합니다 (keep-alive).
+ * 요청들은 연결의 rio 버퍼 하나에서 읽으므로, 응답을 기다리지 않고 이어 보낸 요청(파이프라이닝)은
+ * 버퍼에 남아 있다가 순서대로 처리됩니다. 버퍼가 비었으면 다음 요청을 CLIENT_IDLE_TIMEOUT까지 기다립니다.
+ * 캐시하지 않는 본문을 splice로 옮길 파이프는 연결의 요청들이 함께 씁니다 (처음 쓸 때 만듦).
+ * 연결은 호출자가 닫습니다.
  *
  * clientfd: 클라이언트와의 연결을 나타내는 파일 디스크립터
  */
-void doit(int clientfd)
+void serve_client(int clientfd)
 {
-  int serverfd, content_length; // 원격 서버의 파일 디스크립터 및 응답 콘텐츠 길이
-  char request_buf[MAXLINE], response_buf[MAXLINE]; // HTTP 요청 및 응답 버퍼
-  char method[MAXLINE], uri[MAXLINE], path[MAXLINE], hostname[MAXLINE], port[MAXLINE];
-  char *response_ptr, filename[MAXLINE], cgiargs[MAXLINE]; // 파싱된 URI의 구성 요소 및 응답 포인터
-  rio_t request_rio, response_rio; // Robust I/O 구조체
+  rio_t request_rio;
+  int relay_pipe[2] = {-1, -1};
 
-  // 클라이언트 요청 읽기 및 출력
   Rio_readinitb(&request_rio, clientfd);
-  Rio_readlineb(&request_rio, request_buf, MAXLINE);
-  printf("Request headers:\n %s\n", request_buf);
+  while (doit(clientfd, &request_rio, relay_pipe) &&
+         (request_rio.rio_cnt > 0 || rio_wait_timeout(clientfd, POLLIN, CLIENT_IDLE_TIMEOUT * 1000)))
+    ;
+  if (relay_pipe[0] >= 0)
+  {
+    close(relay_pipe[0]);
+    close(relay_pipe[1]);
+  }
+}
 
-  // 요청에서 HTTP 메소드와 URI 추출
-  sscanf(request_buf, "%s %s", method, uri);
-  parse_uri(uri, hostname, port, path);
-    printf("Parsed URI: Hostname = %s, Port = %s, Path = %s\n", hostname, port, path);
+/**
+ * client_keepalive 함수: 응답 뒤에도 클라이언트 연결을 유지할지 정합니다.
+ * HTTP/1.1 요청은 "close"가 없으면, HTTP/1.0 요청은 "keep-alive"가 있으면 유지합니다 (RFC 9112 9.3).
+ */
+static int client_keepalive(int reqflags)
+{
+  return !(reqflags & HDR_CLOSE) && (reqflags & (HDR_HTTP11 | HDR_KEEP_ALIVE));
+}
+
+/**
+ * send_header 함수: 홉별 필드를 뺀 응답 헤더의 빈 줄 앞에 이 연결의 Connection 필드를 끼워 보냅니다.
+ * chunked로 보내면 Transfer-Encoding 필드도 붙이고 상태 줄의 버전을 HTTP/1.1로 올립니다.
+ * hdr, len: http_end_to_end가 만든 헤더와 그 길이
+ * 반환: 0, 클라이언트가 연결을 끊었으면 -1
+ */
+static int send_header(int clientfd, char *hdr, size_t len, int keepalive, int chunked)
+{
+  char fields[MAXLINE];
+  struct iovec iov[2];
 
-  sprintf(request_buf, "%s %s %s\r\n", method, path, "HTTP/1.0");
+  if (chunked && !strncmp(hdr, "HTTP/1.0", strlen("HTTP/1.0")))
+    hdr[strlen("HTTP/1.")] = '1'; // Transfer-Encoding은 HTTP/1.1 메시지에만 쓸 수 있음
+  iov[0].iov_base = hdr;
+  iov[0].iov_len = len - 2;
+  iov[1].iov_base = fields;
+  iov[1].iov_len = sprintf(fields, "%s%s\r\n", chunked ? "Transfer-Encoding: chunked\r\n" : "",
+                           keepalive ? CONN_KEEP_ALIVE : CONN_CLOSE);
+  return rio_writev(clientfd, iov, 2) < 0 ? -1 : 0;
+}
 
-  // 지원하지 않는 메소드에 대해 클라이언트에게 오류 메시지 전송
-  if (strcasecmp(method, "GET") && strcasecmp(method, "HEAD"))
+/**
+ * send_chunk 함수: 본문 조각 하나를 chunked 형식(크기 줄, 데이터, CRLF)으로 보냅니다.
+ * 반환: 0, 클라이언트가 연결을 끊었으면 -1
+ */
+static int send_chunk(int clientfd, char *data, size_t n)
+{
+  char size[32];
+  struct iovec iov[3];
+
+  iov[0].iov_base = size;
+  iov[0].iov_len = sprintf(size, "%zx\r\n", n);
+  iov[1].iov_base = data;
+  iov[1].iov_len = n;
+  iov[2].iov_base = "\r\n";
+  iov[2].iov_len = 2;
+  return rio_writev(clientfd, iov, 3) < 0 ? -1 : 0;
+}
+
+/**
+ * splice_body 함수: 캐시하지 않는 응답 본문을 연결의 파이프를 거쳐 원격 서버에서 클라이언트로
+ * 커널 안에서 옮깁니다 (splice). 사용자 공간 버퍼로 읽고 다시 쓰는 복사 두 번이 없습니다.
+ * Rio 버퍼에 이미 읽힌 본문은 먼저 그대로 씁니다. 논블로킹 소켓(코루틴 모드)은 rio_wait로 기다립니다.
+ * 클라이언트가 끊어 파이프에 본문이 남으면 파이프를 닫습니다 (다음 요청이 새로 만듦).
+ *
+ * rp: 원격 서버 연결의 Rio 버퍼, relay_pipe: 연결의 중계 파이프 (만들어져 있어야 함)
+ * content_length: 본문 길이 (-1이면 원격 서버가 닫을 때까지)
+ * 반환: 클라이언트에 보낸 본문 길이
+ */
+static int splice_body(rio_t *rp, int clientfd, int relay_pipe[2], int content_length)
+{
+  int got = 0, want;
+  ssize_t n, k;
+
+  // Rio 버퍼에 남은 본문
+  want = content_length >= 0 && content_length < rp->rio_cnt ? content_length : rp->rio_cnt;
+  if (want > 0)
+  {
+    if (rio_writen(clientfd, rp->rio_bufptr, want) < 0)
+      return 0;
+    rp->rio_bufptr += want;
+    rp->rio_cnt -= want;
+    got = want;
+  }
+
+  while (content_length < 0 || got < content_length)
+  {
+    want = content_length >= 0 && content_length - got < SPLICE_BUFSIZE ? content_length - got : SPLICE_BUFSIZE;
+    n = splice(rp->rio_fd, NULL, relay_pipe[1], NULL, want, SPLICE_F_MOVE);
+    if (n < 0 && errno == EAGAIN)
+    {
+      rio_wait(rp->rio_fd, POLLIN);
+      continue;
+    }
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      break; // EOF 또는 오류
+
+    // 파이프에 들어온 만큼 클라이언트로 (파이프는 매번 비우므로 원격 서버 쪽이 막히지 않음)
+    for (; n > 0; n -= k, got += k)
+    {
+      k = splice(relay_pipe[0], NULL, clientfd, NULL, n, SPLICE_F_MOVE);
+      if (k < 0 && errno == EAGAIN)
+      {
+        rio_wait(clientfd, POLLOUT);
+        k = 0;
+      }
+      else if (k < 0 && errno == EINTR)
+        k = 0;
+      else if (k <= 0)
+      {
+        close(relay_pipe[0]); // 클라이언트가 연결을 끊음
+        close(relay_pipe[1]);
+        relay_pipe[0] = relay_pipe[1] = -1;
+        return got;
+      }
+    }
+  }
+  return got;
+}
+
+/**
+ * doit 함수: 클라이언트로부터의 HTTP 요청 하나를 처리합니다.
+ * 이 함수는 클라이언트의 요청을 읽고, 필요에 따라 캐시된 응답을 전송하거나
+ * 원격 서버에 요청을 전달하여 새로운 응답을 가져옵니다.
+ * 신선하지 않은 캐시 객체는 조건부 요청으로 재검증하고, 304가 오면 캐시된 본문을 보냅니다.
+ * stale-while-revalidate 동안은 캐시된 객체를 바로 보내고 refresh_async로 재검증하며,
+ * 원격 서버에 연결할 수 없거나 5xx를 받으면 stale-if-error 동안 캐시된 객체로 대신 응답합니다.
+ * 같은 경로의 캐시 미스가 이미 원격 서버에서 받아 오는 중이면 그 응답을 함께 받습니다 (flight.c).
+ * 응답 헤더의 홉별 필드는 이 연결의 Connection 필드로 바꾸고, 길이를 모르는 본문은 HTTP/1.1
+ * 클라이언트에게 chunked로 보내 연결을 유지합니다.
+ * 캐시하지도 나누지도 않는 본문(MAX_OBJECT_SIZE보다 큰 본문 포함)은 splice_body로 옮깁니다.
+ *
+ * clientfd: 클라이언트와의 연결을 나타내는 파일 디스크립터
+ * request_rio: 클라이언트 연결의 Rio 버퍼 (이어 보낸 요청이 남아 있을 수 있음)
+ * relay_pipe: 연결의 중계 파이프 (-1이면 splice_body가 필요할 때 만듦)
+ * 반환: 같은 연결로 다음 요청을 받을 수 있으면 1, 연결을 닫아야 하면 0
+ */
+int doit(int clientfd, rio_t *request_rio, int relay_pipe[2])
+{
+  int serverfd, content_length = -1;  // 원격 서버의 파일 디스크립터 및 응답 콘텐츠 길이 (모르면 -1)
+  int n, reqflags, storable, status;  // 요청 길이, 요청 헤더 플래그, 저장 가능 여부, 응답 상태 코드
+  size_t req_len = 0, hdr_len = 0;    // 요청 헤더 블록과 응답 헤더의 길이 (응답 헤더가 MAXLINE을 넘으면 바로 전달)
+  size_t e2e_len = 0;                 // 홉별 필드를 뺀 응답 헤더의 길이 (만들 수 없으면 0)
+  char request[REQ_BUFSIZE], upstream[UPSTREAM_BUFSIZE]; // 클라이언트 요청 헤더 블록과 원격 서버로 보낼 요청
+  char response_hdr[MAXLINE + 1], response_buf[MAXLINE], cond[MAXLINE]; // 응답 헤더, 응답 한 줄, 조건부 헤더
+  char e2e_hdr[MAXLINE + 1];          // 클라이언트에 보내고 캐시에 저장할 응답 헤더
+  char method[MAXLINE], path[MAXLINE], hostname[MAXLINE], port[MAXLINE];
+  char *relay, *body = NULL, *chunk;  // 본문 중계 버퍼, 캐시에 넣을 본문 사본, 이번에 받은 본문 조각
+  int body_len = 0;                   // 본문 사본의 길이
+  rio_t response_rio;                 // Robust I/O 구조체
+  web_object_t *cached_object, *stale = NULL, *fresh;
+  time_t request_time, response_time, expires;
+  flight_t *flight = NULL;            // 리더로서 받아 오는 원격 요청 (다른 미스들이 함께 받음)
+  int leader, followed, got, want, reused, line_len = 0, hdr_done;
+  int keepalive, reuse, chunked = 0;  // 클라이언트 연결 유지, 원격 서버 연결 재사용, chunked 전송 여부
+
+  // 클라이언트 요청 헤더 블록을 빈 줄까지 모두 읽음 (요청 앞의 빈 줄은 건너뜀, RFC 9112 2.2)
+  while (1)
+  {
+    if (req_len >= REQ_BUFSIZE - 1)
+    {
+      clienterror(clientfd, "", "400", "Bad request", "Request header too long");
+      return 0;
+    }
+    if ((n = rio_readlineb(request_rio, request + req_len, REQ_BUFSIZE - req_len)) <= 0)
+      return 0;
+    if (!strcmp(request + req_len, "\r\n") && req_len == 0)
+      continue;
+    req_len += n;
+    if (!strcmp(request + req_len - n, "\r\n"))
+      break;
+  }
+  printf("Request headers:\n %s\n", request);
+
+  // 요청 라인을 해석하고 원격 서버로 보낼 요청을 만듦
+  n = build_request(request, upstream, method, hostname, port, path, &reqflags);
+  if (n == REQ_NOT_IMPL)
   {
     clienterror(clientfd, method, "501", "Not implemented", "Tiny does not implement this method");
-    return;
+    return 0;
+  }
+  if (n == REQ_BAD)
+  {
+    clienterror(clientfd, "", "400", "Bad request", "Proxy could not parse the request");
+    return 0;
+  }
+  printf("Parsed URI: Hostname = %s, Port = %s, Path = %s\n", hostname, port, path);
+  keepalive = client_keepalive(reqflags);
+
+  // 캐시된 객체가 신선하면 참조를 쥔 채로 전송, 재검증 중에 보내도 되면 보내고 백그라운드에서 재검증,
+  // 아니면 검증자로 조건부 요청을 보내 재검증
+  int get = !strcasecmp(method, "GET"); // HEAD 응답은 본문이 없으므로 캐시를 쓰지 않음
+  if (get && (cached_object = lookup_cache(&proxy_cache, path)))
+  {
+    int claim = 0;
+    if (http_fresh(cached_object, reqflags) ||
+        (http_serve_stale(cached_object, reqflags, 0) && (claim = http_claim_refresh(cached_object)) >= 0))
+    {
+      if (send_cache(cached_object, clientfd, keepalive) < 0)
+        keepalive = 0;
+      if (claim)
+        refresh_async(&proxy_cache, cached_object, upstream, n, hostname, port, reqflags);
+      else
+        release_cache(cached_object);
+      return keepalive;
+    }
+    http_conditional(cached_object, cond, sizeof(cond));
+    n = http_add_conditional(upstream, n, sizeof(upstream), cond);
+    stale = cached_object;
+  }
+  else if (get)
+  {
+    // 같은 경로를 이미 받아 오는 요청이 있으면 그 응답을 함께 받음 (거절되면 직접 받아 옴)
+    flight = flight_join(&proxy_cache, path, &leader);
+    if (!leader && (followed = follow_flight(flight, clientfd, keepalive)) != 0)
+      return followed > 0 && keepalive;
+    if (!leader)
+      flight = NULL;
   }
 
-  // 캐시된 객체가 있는지 확인하고, 있으면 해당 캐시를 전송
-  web_object_t *cached_object = find_cache(path);
-  if (cached_object) 
+  // 원격 서버에 요청 전송 (쉬는 연결이 있으면 재사용)
+  request_time = time(NULL);
+  if ((serverfd = upstream_send(hostname, port, upstream, n, 1, &reused)) >= 0)
   {
-    send_cache(cached_object, clientfd); 
-    read_cache(cached_object);           
-    return;                              
+    Rio_readinitb(&response_rio, serverfd);
+    line_len = rio_readlineb(&response_rio, response_buf, MAXLINE);
+  }
+  if (serverfd >= 0 && line_len <= 0 && reused)
+  {
+    // 쉬던 연결을 원격 서버가 그 사이 닫았으면 새 연결로 다시 보냄 (GET, HEAD는 다시 보내도 안전)
+    close(serverfd);
+    if ((serverfd = upstream_send(hostname, port, upstream, n, 0, &reused)) >= 0)
+    {
+      Rio_readinitb(&response_rio, serverfd);
+      line_len = rio_readlineb(&response_rio, response_buf, MAXLINE);
+    }
   }
 
-  // 원격 서버에 연결
-  serverfd = is_local_test ? Open_clientfd(hostname, port) : Open_clientfd("15.164.95.158", port);
+  // 연결할 수 없으면 보내도 되는 캐시 객체로 대신 응답
   if (serverfd < 0)
   {
-    clienterror(serverfd, method, "502", "Bad Gateway", "📍 Failed to establish connection with the end server");
-    return;
+    if (stale && http_serve_stale(stale, reqflags, 1))
+    {
+      if (send_cache(stale, clientfd, keepalive) < 0)
+        keepalive = 0;
+    }
+    else
+    {
+      clienterror(clientfd, method, "502", "Bad Gateway", "📍 Failed to establish connection with the end server");
+      keepalive = 0;
+    }
+    if (stale)
+      release_cache(stale);
+    end_flight(flight);
+    return keepalive;
+  }
+
+  // 원격 서버로부터 응답 상태 줄과 헤더를 모두 읽음 (너무 길면 모은 부분부터 바로 전달)
+  for (n = line_len; n > 0; n = rio_readlineb(&response_rio, response_buf, MAXLINE))
+  {
+    if (!strncasecmp(response_buf, "Content-length:", strlen("Content-length:")))
+      content_length = atoi(response_buf + strlen("Content-length:"));
+    if (hdr_len + n <= MAXLINE)
+      memcpy(response_hdr + hdr_len, response_buf, n);
+    else
+    {
+      if (hdr_len <= MAXLINE)
+        rio_writen(clientfd, response_hdr, hdr_len);
+      rio_writen(clientfd, response_buf, n);
+    }
+    hdr_len += n;
+    if (!strcmp(response_buf, "\r\n"))
+      break;
+  }
+  hdr_done = n > 0;
+  response_time = time(NULL);
+  if (hdr_len <= MAXLINE)
+    response_hdr[hdr_len] = '\0';
+
+  // 재검증 결과가 304면 캐시된 본문을 갱신된 헤더와 함께 보내고 캐시의 객체를 바꿈,
+  // 원격 서버가 응답하지 못했거나 5xx면 보내도 되는 캐시 객체로 대신 응답
+  status = hdr_len <= MAXLINE ? http_status(response_hdr) : 0;
+  if (!response_has_body(!get, status))
+    content_length = 0;
+  reuse = hdr_len > 0 && hdr_len <= MAXLINE && upstream_keepalive(response_hdr);
+  if (stale && (status == 304 || ((hdr_len == 0 || status >= 500) && http_serve_stale(stale, reqflags, 1))))
+  {
+    fresh = status == 304 ? http_refresh(stale, response_hdr, reqflags, request_time, response_time, &storable) : NULL;
+    if (send_cache(fresh ? fresh : stale, clientfd, keepalive) < 0)
+      keepalive = 0;
+    if (fresh && storable)
+      write_cache(&proxy_cache, fresh);
+    else if (fresh)
+      free_cache_object(fresh);
+    release_cache(stale);
+    if (reuse && status == 304 && response_rio.rio_cnt == 0)
+      upstream_put(serverfd, hostname, port);
+    else
+      close(serverfd);
+    return keepalive;
+  }
+  if (stale)
+    release_cache(stale);
+
+  // 원격 서버가 상태 줄도 보내지 않고 연결을 닫았으면 빈 응답 대신 502로 응답
+  if (hdr_len == 0)
+  {
+    clienterror(clientfd, method, "502", "Bad Gateway", "📍 The end server closed the connection without a response");
+    close(serverfd);
+    end_flight(flight);
+    return 0;
+  }
+
+  // 홉별 필드를 이 연결의 Connection 필드로 바꿔 헤더를 보냄. 길이를 모르는 본문은 HTTP/1.1
+  // 클라이언트에게 chunked로 보내고, 아니면 연결을 닫아 끝을 알림 (헤더를 바꿀 수 없을 때도 닫음)
+  if (hdr_done && hdr_len <= MAXLINE && (e2e_len = http_end_to_end(e2e_hdr, sizeof(e2e_hdr), response_hdr, -1)) > 0)
+  {
+    if (content_length < 0)
+      keepalive = chunked = keepalive && (reqflags & HDR_HTTP11);
+    if (send_header(clientfd, e2e_hdr, e2e_len, keepalive, chunked) < 0)
+      keepalive = 0;
+  }
+  else
+  {
+    keepalive = 0;
+    if (hdr_len <= MAXLINE)
+      rio_writen(clientfd, response_hdr, hdr_len);
   }
-  Rio_writen(serverfd, request_buf, strlen(request_buf));
 
-  // 원격 서버에 요청 헤더 전송
-  read_requesthdrs(&request_rio, request_buf, serverfd, hostname, port);
+  // 길이를 아는 캐시할 수 있는 응답이면 함께 기다리는 미스들에게 나누고, 아니면 직접 받아 오도록 거절
+  int cacheable = get && content_length <= MAX_OBJECT_SIZE && hdr_len <= MAXLINE &&
+                  http_storable(path, reqflags, response_hdr, request_time, response_time, &expires);
+  if (flight && cacheable && content_length >= 0 && e2e_len > 0)
+  {
+    flight_start(flight, e2e_len + content_length);
+    flight_publish(flight, e2e_hdr, e2e_len);
+  }
+  else if (flight)
+  {
+    end_flight(flight);
+    flight = NULL;
+  }
 
-  // 원격 서버로부터의 응답 읽기 및 클라이언트에 전송
-  Rio_readinitb(&response_rio, serverfd);
-  while (strcmp(response_buf, "\r\n"))
+  // 응답 본문을 받는 대로 전송 (본문 크기와 관계없이 연결마다 버퍼 하나만 사용)
+  // 길이를 아는 캐시할 수 있는 본문은 사본에 바로 읽어 들이고, 길이를 모르면 중계 버퍼에서
+  // 사본에 덧붙이다가 MAX_OBJECT_SIZE를 넘으면 사본을 버림 (Content-length가 없으면 EOF까지)
+  // 사본도 chunked 틀도 필요 없는 본문은 파이프를 거쳐 커널 안에서 옮김
+  if (!cacheable && !flight && !chunked &&
+      (relay_pipe[0] >= 0 || pipe2(relay_pipe, O_CLOEXEC) == 0))
+    got = splice_body(&response_rio, clientfd, relay_pipe, content_length);
+  else
   {
-    Rio_readlineb(&response_rio, response_buf, MAXLINE);
-    if (strstr(response_buf, "Content-length")) 
-      content_length = atoi(strchr(response_buf, ':') + 1);
-    Rio_writen(clientfd, response_buf, strlen(response_buf));
+    if (cacheable && content_length >= 0)
+      body = slab_alloc(content_length + 1);
+    relay = body ? NULL : slab_alloc(BODY_BUFSIZE);
+    for (got = 0; content_length < 0 || got < content_length; got += n)
+    {
+      want = content_length >= 0 && content_length - got < BODY_BUFSIZE ? content_length - got : BODY_BUFSIZE;
+      chunk = relay ? relay : body + got;
+      if ((n = rio_readsomeb(&response_rio, chunk, want)) <= 0)
+        break;
+      if (relay && cacheable)
+        cacheable = tee_body(&body, &body_len, chunk, n);
+      if (flight)
+        flight_publish(flight, chunk, n);
+      if ((chunked ? send_chunk(clientfd, chunk, n) : rio_writen(clientfd, chunk, n)) < 0)
+        break; // 클라이언트가 연결을 끊음
+    }
+    slab_free(relay);
   }
 
-  // 응답 본문 읽기 및 전송
-  response_ptr = malloc(content_length);
-  Rio_readnb(&response_rio, response_ptr, content_length);
-  Rio_writen(clientfd, response_ptr, content_length); 
+  // 본문을 끝까지 보냈을 때만 연결을 유지 (chunked면 마지막 조각까지)
+  if (chunked && n == 0 && rio_writen(clientfd, "0\r\n\r\n", 5) < 0)
+    keepalive = 0;
+  if (content_length >= 0 ? got != content_length : !chunked || n != 0)
+    keepalive = 0;
 
-  // 응답 크기에 따라 캐시 작업 결정
-  if (content_length <= MAX_OBJECT_SIZE) 
+  // 온전히 받은 캐시할 수 있는 응답은 홉별 필드를 뺀 헤더와 함께 저장 (길이를 몰랐으면 받은 길이를 채움)
+  if (cacheable && (content_length < 0 ? n == 0 && body : got == content_length) &&
+      (e2e_len = http_end_to_end(e2e_hdr, sizeof(e2e_hdr), response_hdr, got)) > 0)
   {
-    web_object_t *web_object = (web_object_t *)calloc(1, sizeof(web_object_t));
-    web_object->response_ptr = response_ptr;
-    web_object->content_length = content_length;
-    strcpy(web_object->path, path);
-    write_cache(web_object); 
+    web_object_t *web_object = new_cache_object(path, e2e_hdr, e2e_len, body, got);
+    web_object->expires = expires;
+    write_cache(&proxy_cache, web_object);
   }
   else
-    free(response_ptr); 
+    slab_free(body);
+  end_flight(flight);
 
-  // 원격 서버 연결 종료
-  Close(serverfd);
+  // 응답의 끝까지 정확히 읽었고 원격 서버가 연결을 유지하면 다음 요청을 위해 풀에 돌려줌
+  if (reuse && content_length >= 0 && got == content_length && response_rio.rio_cnt == 0)
+    upstream_put(serverfd, hostname, port);
+  else
+    close(serverfd);
+  return keepalive;
+}
+
+/**
+ * upstream_send 함수: 원격 서버에 요청을 보낸 연결을 얻습니다. pooled이면 풀에 쉬는 연결을
+ * 먼저 재사용하고, 없거나 보낼 수 없으면 새로 연결합니다.
+ * req, n: 보낼 요청과 그 길이
+ * reused: 재사용한 연결이면 1을 저장 (응답 없이 닫히면 호출자가 새 연결로 다시 보냄)
+ * 반환: 요청을 보낸 연결, 원격 서버에 연결할 수 없으면 -1
+ */
+static int upstream_send(char *hostname, char *port, char *req, int n, int pooled, int *reused)
+{
+  int fd;
+
+  if (pooled && (fd = upstream_get(hostname, port)) >= 0)
+  {
+    if (rio_writen(fd, req, n) == n)
+    {
+      *reused = 1;
+      return fd;
+    }
+    close(fd);
+  }
+  *reused = 0;
+  if ((fd = dns_open_clientfd(origin_host(hostname), port)) < 0)
+    return -1;
+  if (rio_writen(fd, req, n) != n)
+  {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+/**
+ * follow_flight 함수: 같은 경로를 받아 오는 리더의 응답을 팔로워로서 도착하는 대로 클라이언트에 보냅니다.
+ * 리더가 공개할 때마다 eventfd로 깨어납니다 (코루틴 모드에서는 rio_wait로 양보).
+ * 공개된 헤더에는 홉별 필드가 없으므로 빈 줄 앞에 이 연결의 Connection 필드를 끼워 보냅니다.
+ * keepalive: 응답 뒤에도 클라이언트 연결을 유지하려면 1
+ * 반환: 응답을 모두 보냈으면 1, 리더가 도중에 실패했거나 클라이언트가 끊었으면 -1,
+ *       리더가 나누기를 거절했으면 0
+ */
+static int follow_flight(flight_t *flight, int clientfd, int keepalive)
+{
+  int efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  enum flight_state state = FLIGHT_DECLINED;
+  size_t sent = 0, len;
+  char *eoh;
+  struct iovec iov[3];
+  uint64_t v;
+
+  if (efd < 0)
+  {
+    flight_leave(flight, -1);
+    return 0;
+  }
+  flight_watch(flight, efd);
+  while (1)
+  {
+    state = flight_poll(flight, &len);
+    if (sent == 0 && len > 0 && (eoh = memmem(flight->data, len, "\r\n\r\n", 4)) != NULL)
+    {
+      // 헤더는 한 번에 공개되므로 처음 공개된 바이트에 빈 줄까지 들어 있음
+      sent = eoh - flight->data + 2;
+      iov[0].iov_base = flight->data;
+      iov[0].iov_len = sent;
+      iov[1].iov_base = keepalive ? CONN_KEEP_ALIVE "\r\n" : CONN_CLOSE "\r\n";
+      iov[1].iov_len = strlen(iov[1].iov_base);
+      iov[2].iov_base = eoh + 4;
+      iov[2].iov_len = len - sent - 2;
+      if (rio_writev(clientfd, iov, 3) < 0)
+      {
+        state = FLIGHT_FAILED;
+        break;
+      }
+      sent = len;
+    }
+    else if (sent < len)
+    {
+      if (rio_writen(clientfd, flight->data + sent, len - sent) < 0)
+      {
+        state = FLIGHT_FAILED;
+        break;
+      }
+      sent = len;
+    }
+    else if (state != FLIGHT_PENDING && state != FLIGHT_STREAM)
+      break;
+    else
+    {
+      rio_wait(efd, POLLIN);
+      if (read(efd, &v, sizeof(v)) < 0 && errno != EAGAIN)
+        break;
+    }
+  }
+  flight_leave(flight, efd);
+  close(efd);
+  if (state == FLIGHT_DECLINED)
+    return 0;
+  return state == FLIGHT_DONE && sent == len ? 1 : -1;
+}
+
+/**
+ * end_flight 함수: 리더로서 받아 오던 원격 요청을 끝내고 참조를 놓습니다 (flight가 NULL이면 무시).
+ */
+static void end_flight(flight_t *flight)
+{
+  if (!flight)
+    return;
+  flight_end(flight);
+  flight_leave(flight, -1);
+}
+
+/**
+ * refresh_t 구조체: 백그라운드 재검증 하나의 인자입니다.
+ * stale: 재검증할 객체 (http_claim_refresh로 맡았고 참조를 가진 상태)
+ * request, n: build_request가 만든 원격 서버 요청과 그 길이
+ */
+typedef struct refresh_t
+{
+  cache_t *cache;
+  web_object_t *stale;
+  int reqflags;
+  char hostname[MAXLINE], port[MAXLINE];
+  int n;
+  char request[UPSTREAM_BUFSIZE];
+} refresh_t;
+
+/**
+ * refresh_fetch 함수: 신선하지 않은 객체를 원격 서버에 재검증하여 캐시의 객체를 바꿉니다.
+ * 304면 헤더만 갱신하고, 새 응답이면 저장할 수 있을 때 새 객체로 바꿉니다.
+ * 오류가 나도 프로세스를 끝내지 않도록 Rio 래퍼 대신 rio 함수를 씁니다.
+ */
+static void refresh_fetch(refresh_t *r)
+{
+  char hdr[MAXLINE + 1], line[MAXLINE], cond[MAXLINE], stored[MAXLINE + 1], *body;
+  int serverfd, storable, content_length = -1;
+  size_t hdr_len = 0, stored_len;
+  ssize_t len;
+  time_t request_time, response_time, expires;
+  rio_t rio;
+  web_object_t *web_object;
+
+  http_conditional(r->stale, cond, sizeof(cond));
+  r->n = http_add_conditional(r->request, r->n, sizeof(r->request), cond);
+  if ((serverfd = dns_open_clientfd(origin_host(r->hostname), r->port)) < 0)
+    return;
+  request_time = time(NULL);
+  if (rio_writen(serverfd, r->request, r->n) != r->n)
+    goto out;
+
+  // 응답 상태 줄과 헤더를 모두 읽음
+  rio_readinitb(&rio, serverfd);
+  do
+  {
+    if ((len = rio_readlineb(&rio, line, MAXLINE)) <= 0 || hdr_len + len > MAXLINE)
+      goto out;
+    if (!strncasecmp(line, "Content-length:", strlen("Content-length:")))
+      content_length = atoi(line + strlen("Content-length:"));
+    memcpy(hdr + hdr_len, line, len);
+    hdr_len += len;
+  } while (strcmp(line, "\r\n"));
+  hdr[hdr_len] = '\0';
+  response_time = time(NULL);
+
+  if (http_status(hdr) == 304)
+  {
+    if ((web_object = http_refresh(r->stale, hdr, r->reqflags, request_time, response_time, &storable)) && storable)
+      write_cache(r->cache, web_object);
+    else if (web_object)
+      free_cache_object(web_object);
+  }
+  else if (content_length >= 0 && content_length <= MAX_OBJECT_SIZE &&
+           http_storable(r->stale->path, r->reqflags, hdr, request_time, response_time, &expires))
+  {
+    body = slab_alloc(content_length);
+    if (rio_readnb(&rio, body, content_length) != content_length ||
+        !(stored_len = http_end_to_end(stored, sizeof(stored), hdr, content_length)))
+    {
+      slab_free(body);
+      goto out;
+    }
+    web_object = new_cache_object(r->stale->path, stored, stored_len, body, content_length);
+    web_object->expires = expires;
+    write_cache(r->cache, web_object);
+  }
+out:
+  close(serverfd);
+}
+
+/**
+ * refresh_thread 함수: 백그라운드 재검증 스레드의 본체입니다.
+ */
+static void *refresh_thread(void *vargp)
+{
+  refresh_t *r = vargp;
+
+  refresh_fetch(r);
+  http_release_refresh(r->stale);
+  release_cache(r->stale);
+  free(r);
+  return NULL;
+}
+
+/**
+ * refresh_async 함수: 신선하지 않은 객체를 분리된 스레드에서 재검증합니다 (stale-while-revalidate).
+ * 요청을 처리하는 쪽(doit, 이벤트 루프)은 원격 서버를 기다리지 않고 캐시된 객체로 바로 응답합니다.
+ * cache: 갱신할 캐시
+ * stale: http_claim_refresh로 맡은 객체 (참조의 소유권이 넘어감)
+ * req, n: build_request가 만든 원격 서버 요청과 그 길이
+ * hostname, port: 원격 서버, reqflags: 요청 헤더 플래그
+ */
+void refresh_async(cache_t *cache, web_object_t *stale, char *req, int n, char *hostname, char *port, int reqflags)
+{
+  pthread_t tid;
+  pthread_attr_t attr;
+  refresh_t *r = Malloc(sizeof(refresh_t));
+
+  r->cache = cache;
+  r->stale = stale;
+  r->reqflags = reqflags;
+  strcpy(r->hostname, hostname);
+  strcpy(r->port, port);
+  memcpy(r->request, req, n + 1);
+  r->n = n;
+
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+  if (pthread_create(&tid, &attr, refresh_thread, r) != 0)
+  {
+    http_release_refresh(stale);
+    release_cache(stale);
+    free(r);
+  }
+  pthread_attr_destroy(&attr);
 }
 
 /**
@@ -300,28 +933,50 @@ void doit(int clientfd)
  */
 void clienterror(int fd, char *cause, char *errnum, char *shortmsg, char *longmsg)
 {
-  char buf[MAXLINE], body[MAXBUF];          // HTTP 응답 및 HTML 본문을 위한 버퍼
+  char buf[MAXLINE + MAXBUF];               // HTTP 응답 헤더와 HTML 본문을 위한 버퍼
+
+  // 오류 응답 전체를 구성하여 클라이언트에게 한 번에 전송합니다.
+  int n = format_clienterror(buf, cause, errnum, shortmsg, longmsg);
+  rio_writen(fd, buf, n); // 클라이언트가 끊었으면 무시 (호출자가 연결을 닫음)
+}
+
+/**
+ * format_clienterror 함수: HTTP 오류 응답(헤더와 HTML 본문)을 버퍼에 작성합니다.
+ * clienterror와 이벤트 루프 모드가 함께 사용합니다.
+ *
+ * buf: 응답을 저장할 버퍼 (MAXLINE + MAXBUF 이상)
+ * 나머지 인자는 clienterror와 같습니다.
+ * 반환: 작성된 응답의 길이
+ */
+int format_clienterror(char *buf, char *cause, char *errnum, char *shortmsg, char *longmsg)
+{
+  char body[MAXBUF];                        // HTML 본문을 위한 버퍼
 
   // HTML 오류 페이지의 본문을 구성합니다.
-  sprintf(body, "<html><title>Tiny Error</title>");
-  sprintf(body, "%s<body bgcolor="
-                "ffffff"
-                ">\r\n",
-          body);
-  sprintf(body, "%s%s: %s\r\n", body, errnum, shortmsg);
-  sprintf(body, "%s<p>%s: %s\r\n", body, longmsg, cause);
-  sprintf(body, "%s<hr><em>The Tiny Web server</em>\r\n", body);
+  int len = snprintf(body, MAXBUF, "<html><title>Tiny Error</title>"
+                                   "<body bgcolor=ffffff>\r\n"
+                                   "%s: %s\r\n"
+                                   "<p>%s: %.*s\r\n"
+                                   "<hr><em>The Tiny Web server</em>\r\n",
+                     errnum, shortmsg, longmsg, MAXLINE / 2, cause);
 
-  // HTTP 응답 헤더를 구성하고 클라이언트에게 전송합니다.
-  sprintf(buf, "HTTP/1.0 %s %s\r\n", errnum, shortmsg);
-  Rio_writen(fd, buf, strlen(buf));
-  sprintf(buf, "Content-type: text/html\r\n");
-  Rio_writen(fd, buf, strlen(buf));
-  sprintf(buf, "Content-length: %d\r\n\r\n", (int)strlen(body));
-  Rio_writen(fd, buf, strlen(buf));
+  // HTTP 응답 헤더 뒤에 본문을 붙입니다 (오류 응답 뒤에는 연결을 닫음).
+  return sprintf(buf, "HTTP/1.0 %s %s\r\n"
+                      "Content-type: text/html\r\n"
+                      "Content-length: %d\r\n"
+                      CONN_CLOSE "\r\n%s",
+                 errnum, shortmsg, len, body);
+}
 
-  // 구성된 HTML 오류 페이지를 클라이언트에게 전송합니다.
-  Rio_writen(fd, body, strlen(body));
+/**
+ * origin_host 함수: 실제로 연결할 원격 서버의 호스트를 반환합니다.
+ * 로컬 테스트가 아니면 고정된 원격 서버 주소를 사용합니다.
+ *
+ * hostname: 요청 URI에서 파싱된 호스트명
+ */
+char *origin_host(char *hostname)
+{
+  return is_local_test ? hostname : "15.164.95.158";
 }
 
 /**
@@ -349,7 +1004,9 @@ void parse_uri(char *uri, char *hostname, char *port, char *path)
   if (port_ptr) 
   {
     strncpy(port, port_ptr + 1, path_ptr - port_ptr - 1); 
+    port[path_ptr - port_ptr - 1] = '\0';
     strncpy(hostname, hostname_ptr, port_ptr - hostname_ptr); 
+    hostname[port_ptr - hostname_ptr] = '\0';
   }
   else 
   {
@@ -358,80 +1015,395 @@ void parse_uri(char *uri, char *hostname, char *port, char *path)
     else
       strcpy(port, "8000");
     strncpy(hostname, hostname_ptr, path_ptr - hostname_ptr);
+    hostname[path_ptr - hostname_ptr] = '\0';
+  }
+}
+
+/**
+ * rewrite_requesthdr 함수: 요청 헤더 한 줄을 프록시의 요구 사항에 맞게 제자리에서 수정합니다.
+ * "Proxy-Connection", "Connection", "User-Agent" 헤더는 고정된 값으로 바꾸고
+ * (원격 서버 연결은 upstream.c의 풀에서 재사용하므로 keep-alive를 요청),
+ * "Host" 헤더는 그대로 둡니다. 캐시 동작에 영향을 주는 헤더(Cache-Control, Pragma, Authorization)는
+ * 그대로 두고 플래그로만 알립니다. 바꾸기 전의 Connection, Proxy-Connection 값은 클라이언트 연결을
+ * 유지할지 정하도록 HDR_KEEP_ALIVE, HDR_CLOSE로 알립니다.
+ *
+ * hdr: 수정할 헤더 한 줄 (MAXLINE 크기 버퍼, "\r\n"으로 끝남)
+ * 반환: 발견한 헤더에 해당하는 HDR_* 플래그, 해당 없으면 0
+ */
+int rewrite_requesthdr(char *hdr)
+{
+  if (!strncasecmp(hdr, "Cache-Control:", strlen("Cache-Control:")))
+    return (strcasestr(hdr, "no-cache") || strcasestr(hdr, "max-age=0") ? HDR_NO_CACHE : 0) |
+           (strcasestr(hdr, "no-store") ? HDR_NO_STORE : 0);
+  if (!strncasecmp(hdr, "Pragma:", strlen("Pragma:")))
+    return strcasestr(hdr, "no-cache") ? HDR_NO_CACHE : 0;
+  if (!strncasecmp(hdr, "Authorization:", strlen("Authorization:")))
+    return HDR_AUTHORIZATION;
+  int conn = strcasestr(hdr, "close") ? HDR_CLOSE : strcasestr(hdr, "keep-alive") ? HDR_KEEP_ALIVE : 0;
+  if (strstr(hdr, "Proxy-Connection") != NULL)
+  {
+    sprintf(hdr, "Proxy-Connection: keep-alive\r\n");
+    return HDR_PROXY_CONNECTION | conn;
   }
+  if (strstr(hdr, "Connection") != NULL)
+  {
+    sprintf(hdr, "Connection: keep-alive\r\n");
+    return HDR_CONNECTION | conn;
+  }
+  if (strstr(hdr, "User-Agent") != NULL)
+  {
+    strcpy(hdr, user_agent_hdr);
+    return HDR_USER_AGENT;
+  }
+  if (strstr(hdr, "Host") != NULL)
+    return HDR_HOST;
+  return 0;
 }
 
 /**
- * read_requesthdrs 함수: 클라이언트로부터 받은 HTTP 요청 헤더를 읽고 수정한 후 원격 서버에 전송합니다.
- * 이 함수는 특정 헤더를 변경하거나 추가하여 프록시 서버의 요구 사항에 맞게 요청을 조정합니다.
+ * append_missing_hdrs 함수: 요청에 없었던 필수 헤더와 헤더 끝의 빈 줄을 버퍼에 작성합니다.
  *
- * request_rio: 클라이언트로부터 읽은 요청을 위한 Robust I/O 스트림 포인터
- * request_buf: 요청 헤더를 저장할 버퍼
- * serverfd: 요청을 전달할 원격 서버의 파일 디스크립터
- * hostname: 요청을 전송할 호스트 이름
- * port: 요청을 전송할 포트 번호
- */
-void read_requesthdrs(rio_t *request_rio, void *request_buf, int serverfd, char *hostname, char *port)
-{
-  // 헤더 존재 여부를 추적하는 플래그
-  int is_host_exist = 0;
-  int is_connection_exist = 0;
-  int is_proxy_connection_exist = 0;
-  int is_user_agent_exist = 0;
-
-  // 클라이언트로부터 헤더를 읽고, 필요한 수정을 하여 서버에 전달
-  Rio_readlineb(request_rio, request_buf, MAXLINE);
-  while (strcmp(request_buf, "\r\n"))
-  {
-    // "Proxy-Connection", "Connection", "User-Agent", "Host" 헤더의 존재 여부 확인 및 수정
-    if (strstr(request_buf, "Proxy-Connection") != NULL)
+ * buf: 헤더를 작성할 버퍼 (MAXLINE 이상)
+ * seen: rewrite_requesthdr가 반환한 플래그들의 OR
+ * hostname, port: Host 헤더에 사용할 호스트 이름과 포트 번호
+ * 반환: 작성된 바이트 수
+ */
+int append_missing_hdrs(char *buf, int seen, char *hostname, char *port)
+{
+  int n = 0;
+
+  if (!(seen & HDR_PROXY_CONNECTION))
+    n += sprintf(buf + n, "Proxy-Connection: keep-alive\r\n");
+  if (!(seen & HDR_CONNECTION))
+    n += sprintf(buf + n, "Connection: keep-alive\r\n");
+  if (!(seen & HDR_HOST))
+    n += snprintf(buf + n, MAXLINE / 2, "Host: %s:%s\r\n", hostname, port);
+  if (!(seen & HDR_USER_AGENT))
+    n += sprintf(buf + n, "%s", user_agent_hdr);
+  n += sprintf(buf + n, "\r\n");
+  return n;
+}
+
+/**
+ * build_request 함수: 메모리에 모인 클라이언트 요청 헤더 블록을 해석하여
+ * 원격 서버로 보낼 요청(요청 라인 + 수정된 헤더)을 만듭니다.
+ *
+ * req: "\r\n\r\n"으로 끝나는 NUL 종료 요청 헤더 블록 (REQ_BUFSIZE 이하)
+ * out: 원격 서버로 보낼 요청을 저장할 버퍼 (UPSTREAM_BUFSIZE 이상)
+ * method, hostname, port, path: 파싱 결과를 저장할 MAXLINE 크기 버퍼
+ * flags: 요청에서 발견한 HDR_* 플래그들의 OR를 저장할 위치 (HTTP/1.1 요청이면 HDR_HTTP11 포함)
+ * 반환: 만든 요청의 길이, 실패하면 REQ_BAD 또는 REQ_NOT_IMPL
+ */
+int build_request(char *req, char *out, char *method, char *hostname, char *port, char *path, int *flags)
+{
+  char uri[MAXLINE], version[MAXLINE], line[MAXLINE], *host_ptr, *p, *eol;
+  int n, seen = 0;
+
+  // 요청 라인에서 HTTP 메소드, URI, 버전 추출
+  if ((n = sscanf(req, "%s %s %s", method, uri, version)) < 2)
+    return REQ_BAD;
+  if (n == 3 && !strcmp(version, "HTTP/1.1"))
+    seen |= HDR_HTTP11;
+  if (strcasecmp(method, "GET") && strcasecmp(method, "HEAD"))
+    return REQ_NOT_IMPL;
+  host_ptr = strstr(uri, "//") ? strstr(uri, "//") + 2 : uri;
+  if (!strchr(host_ptr, '/'))
+    return REQ_BAD;
+  parse_uri(uri, hostname, port, path);
+
+  // 요청 라인과 각 헤더 줄을 수정하여 복사 (너무 긴 줄은 버림)
+  n = snprintf(out, MAXLINE, "%s %s %s\r\n", method, path, "HTTP/1.0");
+  p = strstr(req, "\r\n") + 2;
+  while ((eol = strstr(p, "\r\n")) != NULL && eol != p)
+  {
+    size_t linelen = eol - p + 2;
+    if (linelen < MAXLINE)
     {
-      sprintf(request_buf, "Proxy-Connection: close\r\n");
-      is_proxy_connection_exist = 1;
+      memcpy(line, p, linelen);
+      line[linelen] = '\0';
+      seen |= rewrite_requesthdr(line);
+      linelen = strlen(line);
+      if (n + linelen < REQ_BUFSIZE)
+      {
+        memcpy(out + n, line, linelen);
+        n += linelen;
+      }
     }
-    else if (strstr(request_buf, "Connection") != NULL)
+    p = eol + 2;
+  }
+  *flags = seen;
+  return n + append_missing_hdrs(out + n, seen, hostname, port);
+}
+
+/**
+ * scan_init 함수: 응답 스캔 상태를 초기화합니다. 요청을 보낸 직후에 불러야 합니다.
+ * sc: 초기화할 스캔 상태
+ * hdrbuf, cap: 응답 헤더를 모을 버퍼와 그 크기
+ * head: HEAD 요청이면 1 (응답에 본문이 없음)
+ */
+void scan_init(resp_scan_t *sc, char *hdrbuf, size_t cap, int head)
+{
+  memset(sc, 0, sizeof(*sc));
+  sc->hdr = hdrbuf;
+  sc->hdr_cap = cap;
+  sc->head = head;
+  sc->content_length = -1;
+  sc->request_time = time(NULL);
+}
+
+/**
+ * tee_body 함수: 길이를 모르는 본문의 캐시 사본에 n바이트를 덧붙입니다.
+ * 사본은 슬랩 청크를 두 배씩 키워 가며 모으고, MAX_OBJECT_SIZE를 넘으면 버립니다.
+ * body, body_len: 사본 (처음에는 NULL)과 그 길이 (버린 뒤에는 MAX_OBJECT_SIZE보다 커서 다시 모으지 않음)
+ * 반환: 계속 모으면 1, 사본을 버렸으면 0
+ */
+static int tee_body(char **body, int *body_len, char *data, size_t n)
+{
+  size_t need = *body_len + n, cap = *body ? slab_chunk_size(*body) : 0;
+  char *grown;
+
+  if (need > MAX_OBJECT_SIZE)
+  {
+    slab_free(*body);
+    *body = NULL;
+    *body_len = MAX_OBJECT_SIZE + 1;
+    return 0;
+  }
+  if (need > cap)
+  {
+    for (cap = cap ? cap * 2 : SLAB_MIN_CHUNK; cap < need; cap *= 2)
+      ;
+    grown = slab_alloc(cap < MAX_OBJECT_SIZE ? cap : MAX_OBJECT_SIZE);
+    if (*body)
+      memcpy(grown, *body, *body_len);
+    slab_free(*body);
+    *body = grown;
+  }
+  memcpy(*body + *body_len, data, n);
+  *body_len = need;
+  return 1;
+}
+
+/**
+ * scan_response 함수: 서버에서 받은 바이트를 훑어 응답 헤더의 끝을 찾고,
+ * Content-length를 알아내며, 캐시 가능한 본문은 사본을 모읍니다.
+ * Content-length가 없으면 연결이 끝날 때까지가 본문이므로 MAX_OBJECT_SIZE를 넘기 전까지만 모읍니다.
+ * sc: 스캔 상태
+ * data, n: 이번에 받은 바이트와 길이
+ */
+void scan_response(resp_scan_t *sc, char *data, size_t n)
+{
+  size_t i = 0;
+  char *line;
+
+  while (!sc->hdr_done && i < n)
+  {
+    char ch = data[i++];
+    if (sc->hdr_len < sc->hdr_cap - 1)
+      sc->hdr[sc->hdr_len++] = ch;
+    // "\r\n\r\n" 매칭 진행도 갱신
+    if (ch == (sc->hdr_match % 2 ? '\n' : '\r'))
+      sc->hdr_match++;
+    else
+      sc->hdr_match = (ch == '\r');
+    if (sc->hdr_match == 4)
     {
-      sprintf(request_buf, "Connection: close\r\n");
-      is_connection_exist = 1;
+      sc->hdr_done = 1;
+      sc->hdr[sc->hdr_len] = '\0';
+      sc->status = http_status(sc->hdr);
+      sc->response_time = time(NULL);
+      for (line = strstr(sc->hdr, "\r\n"); line; line = strstr(line, "\r\n"))
+      {
+        line += 2;
+        if (!strncasecmp(line, "Content-length:", strlen("Content-length:")))
+          sc->content_length = atoi(line + strlen("Content-length:"));
+      }
+      if (!response_has_body(sc->head, sc->status))
+        sc->content_length = 0;
+      if (sc->content_length >= 0 && sc->content_length <= MAX_OBJECT_SIZE)
+        sc->body = slab_alloc(sc->content_length + 1);
     }
-    else if (strstr(request_buf, "User-Agent") != NULL)
+  }
+
+  sc->body_seen += n - i;
+  if (sc->hdr_done && sc->content_length < 0 && i < n)
+  {
+    tee_body(&sc->body, &sc->body_len, data + i, n - i); // 연결이 끝날 때까지가 본문
+    return;
+  }
+  if (sc->body && i < n)
+  {
+    size_t k = n - i;
+    if (sc->body_len + k > (size_t)sc->content_length)
     {
-      sprintf(request_buf, user_agent_hdr);
-      is_user_agent_exist = 1;
+      // 알려진 길이보다 많은 본문은 캐시하지 않음
+      slab_free(sc->body);
+      sc->body = NULL;
+      return;
     }
-    else if (strstr(request_buf, "Host") != NULL)
+    memcpy(sc->body + sc->body_len, data + i, k);
+    sc->body_len += k;
+  }
+}
+
+/**
+ * scan_done 함수: 응답의 끝까지 받았는지 확인합니다. 길이를 모르는 본문은 연결이 끝나야 끝납니다.
+ */
+int scan_done(resp_scan_t *sc)
+{
+  return sc->hdr_done && sc->content_length >= 0 && sc->body_seen >= sc->content_length;
+}
+
+/**
+ * response_has_body 함수: 응답에 본문이 따라오는지 확인합니다.
+ * HEAD 요청의 응답과 204, 304 응답은 Content-length와 관계없이 본문이 없습니다 (RFC 9112 6.3).
+ */
+int response_has_body(int head, int status)
+{
+  return !head && status != 204 && status != 304;
+}
+
+/**
+ * scan_storable_hdr 함수: 헤더를 다 읽은 응답의 헤더를 그대로 저장할 수 있고 본문 사본을 모으는 중인지 확인합니다.
+ * 헤더가 버퍼보다 길어 잘렸으면 그대로 저장할 수 없으므로 캐시하지 않습니다.
+ */
+static int scan_storable_hdr(resp_scan_t *sc)
+{
+  return sc->body && sc->hdr_len <= MAXLINE && sc->hdr_len >= 4 &&
+         !memcmp(sc->hdr + sc->hdr_len - 4, "\r\n\r\n", 4);
+}
+
+/**
+ * scan_object 함수: 스캔이 끝난 응답의 본문이 온전하고 HTTP 캐시 규칙상 저장할 수 있으면 캐시 객체로 만듭니다.
+ * 원격 서버가 연결을 닫은 뒤에 부르며, 본문의 소유권은 반환된 객체로 넘어갑니다.
+ * 헤더는 홉별 필드를 빼고 저장하며, sc->hdr는 원격 서버 연결을 풀에 돌려줄지 정하도록 그대로 둡니다.
+ * sc: 스캔 상태
+ * path: 캐시 키로 사용할 경로 (NULL이면 캐시하지 않음)
+ * reqflags: build_request가 알려 준 요청 헤더 플래그
+ * 반환: 새 캐시 객체, 캐시할 수 없으면 NULL
+ */
+web_object_t *scan_object(resp_scan_t *sc, char *path, int reqflags)
+{
+  char hdr[MAXLINE + 1];
+  size_t hdr_len;
+  time_t expires;
+
+  if (sc->content_length < 0 && sc->body)
+    sc->content_length = sc->body_len; // 연결이 끝났으므로 모은 만큼이 본문 전체
+  if (!scan_storable_hdr(sc) || sc->body_len != sc->content_length)
+    return NULL;
+  if (!path || !http_storable(path, reqflags, sc->hdr, sc->request_time, sc->response_time, &expires))
+    return NULL;
+  if (!(hdr_len = http_end_to_end(hdr, sizeof(hdr), sc->hdr, sc->content_length)))
+    return NULL;
+
+  web_object_t *web_object = new_cache_object(path, hdr, hdr_len, sc->body, sc->content_length);
+  web_object->expires = expires;
+  sc->body = NULL;
+  return web_object;
+}
+
+/**
+ * scan_share 함수: 리더의 응답을 같은 경로를 기다리는 미스들에게 나눕니다 (flight.c).
+ * 헤더를 다 읽었을 때 캐시할 수 있는 응답이면 홉별 필드를 뺀 헤더부터 공개하고, 아니면 거절합니다.
+ * 이후에는 불릴 때마다 새로 모인 본문 바이트를 공개합니다. scan_response 뒤에 부릅니다.
+ * flight: 리더로서 시작한 원격 요청, path와 reqflags: scan_object와 같음
+ */
+void scan_share(resp_scan_t *sc, flight_t *flight, char *path, int reqflags)
+{
+  char hdr[MAXLINE + 1];
+  size_t hdr_len;
+  time_t expires;
+
+  if (!sc->hdr_done || sc->shared < 0)
+    return;
+  if (!sc->shared)
+  {
+    if (!scan_storable_hdr(sc) || sc->content_length < 0 ||
+        !http_storable(path, reqflags, sc->hdr, sc->request_time, sc->response_time, &expires) ||
+        !(hdr_len = http_end_to_end(hdr, sizeof(hdr), sc->hdr, -1)))
     {
-      is_host_exist = 1;
+      sc->shared = -1;
+      flight_end(flight); // 팔로워들은 직접 받아 옴
+      return;
     }
-
-    // 수정된 헤더를 원격 서버에 전송
-    Rio_writen(serverfd, request_buf, strlen(request_buf));
-    Rio_readlineb(request_rio, request_buf, MAXLINE);
+    sc->shared = 1;
+    flight_start(flight, hdr_len + sc->content_length);
+    flight_publish(flight, hdr, hdr_len);
+  }
+  if (sc->body && sc->body_len > sc->shared_len)
+  {
+    flight_publish(flight, sc->body + sc->shared_len, sc->body_len - sc->shared_len);
+    sc->shared_len = sc->body_len;
   }
+}
+
+/**
+ * relay_header 함수: 릴레이 버퍼 앞에 있는 원격 서버의 응답 헤더를 클라이언트에 보낼 형태로 바꿉니다.
+ * 홉별 필드를 빼고 Connection: close를 붙이며, 뒤따르는 본문 바이트는 그만큼 밀어 둡니다.
+ * 헤더를 다 읽지 못했거나 잘린 경우, 바꾼 결과가 cap에 맞지 않으면 그대로 둡니다.
+ * sc: buf를 훑은 스캔 상태, buf와 len: 아직 보내지 않은 응답 바이트
+ * cap: buf의 크기 (len보다 RELAY_HDR_ROOM 이상 커야 항상 바꿀 수 있음)
+ * 반환: 바꾼 뒤 buf에 있는 바이트 수
+ */
+size_t relay_header(resp_scan_t *sc, char *buf, size_t len, size_t cap)
+{
+  char *hdr;
+  size_t hdr_len, close_len = strlen(CONN_CLOSE);
 
-  // 누락된 헤더를 추가
-  if (!is_proxy_connection_exist)
+  if (!sc->hdr_done || sc->hdr_len >= sc->hdr_cap - 1 || sc->hdr_len > len)
+    return len;
+  hdr = Malloc(sc->hdr_len + 1);
+  if (!(hdr_len = http_end_to_end(hdr, sc->hdr_len + 1, sc->hdr, -1)) ||
+      hdr_len + close_len + len - sc->hdr_len > cap)
   {
-    sprintf(request_buf, "Proxy-Connection: close\r\n");
-    Rio_writen(serverfd, request_buf, strlen(request_buf));
+    free(hdr);
+    return len;
   }
-  if (!is_connection_exist)
+  memmove(buf + hdr_len + close_len, buf + sc->hdr_len, len - sc->hdr_len);
+  memcpy(buf, hdr, hdr_len - 2);
+  memcpy(buf + hdr_len - 2, CONN_CLOSE "\r\n", close_len + 2);
+  free(hdr);
+  return hdr_len + close_len + len - sc->hdr_len;
+}
+
+/**
+ * follow_data 함수: 팔로워가 클라이언트에 이어서 보낼 바이트를 찾습니다.
+ * 공개된 헤더의 빈 줄 앞에 Connection: close가 끼어 있는 것처럼 sent를 셉니다.
+ * flight: 따라가는 원격 요청, len: 지금까지 공개된 바이트 수 (flight_poll)
+ * sent: 지금까지 클라이언트에 보낸 바이트 수, data: 보낼 바이트의 시작을 돌려받음
+ * 반환: 이어서 보낼 수 있는 바이트 수 (0이면 공개를 더 기다려야 함)
+ */
+size_t follow_data(flight_t *flight, size_t len, size_t sent, char **data)
+{
+  char *eoh;
+  size_t hdr_end, close_len = strlen(CONN_CLOSE);
+
+  if (len == 0 || !(eoh = memmem(flight->data, len, "\r\n\r\n", 4)))
   {
-    sprintf(request_buf, "Connection: close\r\n");
-    Rio_writen(serverfd, request_buf, strlen(request_buf));
+    *data = flight->data + sent;
+    return len - sent;
   }
-  if (!is_host_exist)
+  hdr_end = eoh - flight->data + 2; // 마지막 헤더 줄 끝
+  if (sent < hdr_end)
   {
-    sprintf(request_buf, "Host: %s:%s\r\n", hostname, port);
-    Rio_writen(serverfd, request_buf, strlen(request_buf));
+    *data = flight->data + sent;
+    return hdr_end - sent;
   }
-  if (!is_user_agent_exist)
+  if (sent < hdr_end + close_len)
   {
-    sprintf(request_buf, user_agent_hdr);
-    Rio_writen(serverfd, request_buf, strlen(request_buf));
+    *data = CONN_CLOSE + (sent - hdr_end);
+    return hdr_end + close_len - sent;
   }
+  *data = flight->data + sent - close_len;
+  return len + close_len - sent;
+}
 
-  // 헤더의 끝을 나타내는 빈 줄 전송
-  sprintf(request_buf, "\r\n");
-  Rio_writen(serverfd, request_buf, strlen(request_buf));
-}
\ No newline at end of file
+/**
+ * scan_free 함수: 캐시에 넘기지 않은 본문 사본을 해제합니다.
+ */
+void scan_free(resp_scan_t *sc)
+{
+  slab_free(sc->body);
+  sc->body = NULL;
+}
@@ -0,0 +1,108 @@
+#ifndef __PROXY_H__
+#define __PROXY_H__
+
+#include "csapp.h"
+#include "cache.h"
+#include "flight.h"
+#include "upstream.h"
+#include "dns.h"
+
+// 요청 헤더 존재 여부 플래그 (rewrite_requesthdr 반환 값)
+#define HDR_HOST             0x1
+#define HDR_CONNECTION       0x2
+#define HDR_PROXY_CONNECTION 0x4
+#define HDR_USER_AGENT       0x8
+#define HDR_NO_CACHE         0x10 // Cache-Control: no-cache 또는 max-age=0, Pragma: no-cache (캐시를 쓰려면 재검증)
+#define HDR_NO_STORE         0x20 // Cache-Control: no-store (응답을 저장하지 않음)
+#define HDR_AUTHORIZATION    0x40 // Authorization (공유 캐시는 명시적으로 허락된 응답만 저장)
+#define HDR_KEEP_ALIVE       0x80  // 클라이언트의 Connection 또는 Proxy-Connection: keep-alive
+#define HDR_CLOSE            0x100 // 클라이언트의 Connection 또는 Proxy-Connection: close
+#define HDR_HTTP11           0x200 // HTTP/1.1 요청 (keep-alive가 기본값이고 chunked 응답을 받을 수 있음)
+
+// 메모리 버퍼 기반 모드(epoll, shard, uring)의 요청 버퍼 크기
+#define REQ_BUFSIZE      MAXLINE       // 클라이언트 요청 헤더 블록의 최대 크기
+#define UPSTREAM_BUFSIZE (2 * MAXLINE) // 원격 서버로 보낼 요청의 최대 크기
+#define BODY_BUFSIZE     (16 * 1024)   // doit이 응답 본문을 중계하는 버퍼 크기 (슬랩 크기 클래스에서 재사용)
+#define SPLICE_BUFSIZE   (64 * 1024)   // doit이 splice 한 번에 옮기는 본문 크기 (파이프 기본 용량)
+#define RELAY_HDR_ROOM   (sizeof(CONN_CLOSE) - 1) // relay_header가 응답 헤더에 더하는 최대 바이트 수
+
+#define CLIENT_IDLE_TIMEOUT 5 // keep-alive 클라이언트 연결이 다음 요청을 기다리는 시간 (초)
+
+// build_request 오류 반환 값
+#define REQ_BAD      -1 // 요청을 해석할 수 없음 (400)
+#define REQ_NOT_IMPL -2 // 지원하지 않는 메소드 (501)
+
+/**
+ * resp_scan_t 구조체: 원격 서버 응답의 바이트 흐름을 훑는 상태입니다.
+ * 헤더의 끝과 Content-length를 찾고, 캐시할 수 있는 본문이면 사본을 모읍니다.
+ * hdr: 응답 헤더를 모으는 버퍼 (호출자가 제공), hdr_len/hdr_cap: 사용량/크기
+ * hdr_match: "\r\n\r\n" 매칭 진행도, hdr_done: 헤더를 모두 읽었으면 1
+ * content_length: 응답 본문 길이 (모르면 -1, HEAD 요청이나 204/304 응답이면 0)
+ * head: HEAD 요청의 응답이면 1 (본문이 없음), body_seen: 지금까지 지나간 본문 바이트 수
+ * body, body_len: 캐시할 본문 사본과 지금까지 모은 길이
+ * status: 응답 상태 코드 (헤더를 다 읽은 뒤)
+ * request_time, response_time: 요청을 보낸 시각(scan_init)과 응답 헤더를 다 받은 시각
+ * shared, shared_len: 함께 기다리는 미스들에게 나누는 중이면 1 (거절했으면 -1), 공개한 본문 길이
+ */
+typedef struct resp_scan_t
+{
+  char *hdr;
+  size_t hdr_len, hdr_cap;
+  int hdr_match, hdr_done;
+  int content_length;
+  int head;
+  long body_seen;
+  char *body;
+  int body_len;
+  int status;
+  time_t request_time, response_time;
+  int shared;
+  int shared_len;
+} resp_scan_t;
+
+// 요청 처리 함수 선언
+void parse_uri(char *uri, char *hostname, char *port, char *path);
+int rewrite_requesthdr(char *hdr);
+int append_missing_hdrs(char *buf, int seen, char *hostname, char *port);
+int build_request(char *req, char *out, char *method, char *hostname, char *port, char *path, int *flags);
+int format_clienterror(char *buf, char *cause, char *errnum, char *shortmsg, char *longmsg);
+char *origin_host(char *hostname);
+int response_has_body(int head, int status);
+void refresh_async(cache_t *cache, web_object_t *stale, char *req, int n, char *hostname, char *port, int reqflags);
+
+// 응답 스캔 함수 선언
+void scan_init(resp_scan_t *sc, char *hdrbuf, size_t cap, int head);
+void scan_response(resp_scan_t *sc, char *data, size_t n);
+int scan_done(resp_scan_t *sc);
+web_object_t *scan_object(resp_scan_t *sc, char *path, int reqflags);
+void scan_share(resp_scan_t *sc, flight_t *flight, char *path, int reqflags);
+size_t relay_header(resp_scan_t *sc, char *buf, size_t len, size_t cap);
+size_t follow_data(flight_t *flight, size_t len, size_t sent, char **data);
+void scan_free(resp_scan_t *sc);
+
+// HTTP 캐시 규칙 (httpcache.c)
+int http_status(char *hdr);
+int http_storable(char *path, int reqflags, char *hdr, time_t request_time, time_t response_time, time_t *expires);
+int http_fresh(web_object_t *web_object, int reqflags);
+int http_serve_stale(web_object_t *web_object, int reqflags, int error);
+int http_claim_refresh(web_object_t *web_object);
+void http_release_refresh(web_object_t *web_object);
+int http_conditional(web_object_t *web_object, char *buf, size_t cap);
+int http_add_conditional(char *req, int n, size_t cap, char *cond);
+web_object_t *http_refresh(web_object_t *stale, char *hdr304, int reqflags,
+                           time_t request_time, time_t response_time, int *storable);
+size_t http_end_to_end(char *out, size_t cap, char *hdr, int content_length);
+
+// 이벤트 루프(epoll, shard) 모드 진입점 (event.c)
+void event_main(int listenfd, int nloops);
+void event_shard_main(char *port, int nshards, int steer);
+
+// io_uring 모드 진입점 (uring.c)
+int uring_main(int listenfd, int nloops);
+
+// 코루틴 모드 진입점 (coro.c)
+void coro_main(int listenfd, int nsched, int stack_kb);
+void serve_client(int clientfd);
+int doit(int clientfd, rio_t *request_rio, int relay_pipe[2]);
+
+#endif /* __PROXY_H__ */
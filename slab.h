@@ -0,0 +1,23 @@
+#ifndef __SLAB_H__
+#define __SLAB_H__
+
+#include <stdint.h>
+#include "csapp.h"
+
+// 슬랩 할당기 상수 정의
+#define SLAB_PAGE_SIZE (2 * 1024 * 1024) // 슬랩 페이지 크기 (x86-64 huge page 크기와 같게)
+#define SLAB_ARENA_PAGES 32              // 아레나 하나가 예약하는 슬랩 페이지 수
+#define SLAB_MIN_CHUNK 64                // 가장 작은 크기 클래스
+#define SLAB_MAX_CHUNK (128 * 1024)      // 가장 큰 크기 클래스 (캐시 객체 최대 크기 이상)
+
+// slab_init 옵션
+#define SLAB_HUGE 0x1 // 아레나를 MAP_HUGETLB로 받음 (실패하면 일반 페이지 + THP 권고)
+
+// 슬랩 할당 함수 선언
+void slab_init(int flags);
+void *slab_alloc(size_t size);
+void slab_free(void *ptr);
+size_t slab_chunk_size(void *ptr);
+size_t slab_footprint(void);
+
+#endif /* __SLAB_H__ */
@@ -0,0 +1,142 @@
+#include "tinylfu.h"
+
+/*
+ * tinylfu.c - TinyLFU 빈도 추정기 (캐시 입장 허가용)
+ *
+ * 키의 최근 접근 빈도를 count-min 스케치로 근사합니다. 한 번만 보이는 키가 스케치를 더럽히지
+ * 않도록, 처음 본 키는 doorkeeper 블룸 필터에만 기록하고 두 번째부터 스케치를 올립니다.
+ * 스케치가 sample_size번 바뀔 때마다 모든 카운터를 절반으로 줄이고 doorkeeper를 비워서
+ * 오래된 인기도가 서서히 잊히게 합니다 (노화).
+ *
+ * 기록은 락 없이 여러 스레드에서 불리므로 카운터는 relaxed 원자 연산으로 읽고 씁니다.
+ * 동시에 올린 값 일부가 사라질 수 있지만 추정치로는 충분합니다. 이미 포화된 카운터와
+ * 이미 켜진 비트는 쓰지 않으므로, 자주 쓰이는 키는 공유 캐시 라인을 더럽히지 않습니다.
+ */
+
+/**
+ * tinylfu_init 함수: 빈 추정기를 만듭니다.
+ * width: 행 하나의 카운터 수 (2의 거듭제곱으로 올림, 추적할 키 수 정도가 적당)
+ */
+void tinylfu_init(tinylfu_t *f, size_t width)
+{
+  size_t w = TINYLFU_MIN_WIDTH;
+
+  while (w < width)
+    w *= 2;
+  f->width = w;
+  f->counts = Calloc(TINYLFU_DEPTH * w, 1);
+  f->door = Calloc(w / 8, sizeof(uint64_t)); // w * 8비트
+  f->additions = 0;
+  f->sample_size = 10 * w;
+}
+
+/**
+ * tinylfu_deinit 함수: 추정기의 메모리를 해제합니다.
+ */
+void tinylfu_deinit(tinylfu_t *f)
+{
+  free(f->counts);
+  free(f->door);
+}
+
+/**
+ * tinylfu_index 함수: i번째 해시 함수의 값을 구합니다 (이중 해싱).
+ */
+static inline size_t tinylfu_index(uint64_t hash, int i, size_t mask)
+{
+  uint64_t a = hash * 0x9E3779B97F4A7C15ULL;
+  uint64_t b = (hash >> 29 | hash << 35) | 1;
+  return (a + i * b) >> 7 & mask;
+}
+
+/**
+ * tinylfu_door 함수: doorkeeper에 키를 넣습니다.
+ * 반환: 이미 들어 있었으면 1
+ */
+static int tinylfu_door(tinylfu_t *f, uint64_t hash)
+{
+  size_t mask = f->width * 8 - 1, bit;
+  int i, seen = 1;
+
+  for (i = 0; i < 2; i++)
+  {
+    bit = tinylfu_index(hash, TINYLFU_DEPTH + i, mask);
+    uint64_t m = 1ULL << (bit & 63);
+    if (!(__atomic_load_n(&f->door[bit >> 6], __ATOMIC_RELAXED) & m))
+    {
+      __atomic_fetch_or(&f->door[bit >> 6], m, __ATOMIC_RELAXED);
+      seen = 0;
+    }
+  }
+  return seen;
+}
+
+/**
+ * tinylfu_record 함수: 키에 한 번 접근했음을 기록합니다.
+ * hash: 키의 64비트 해시
+ * 반환: 노화할 때가 되었으면 1 (호출자가 다른 기록자와 겹치지 않게 tinylfu_age를 부름)
+ */
+int tinylfu_record(tinylfu_t *f, uint64_t hash)
+{
+  size_t mask = f->width - 1;
+  uint8_t *c, v;
+  int i, changed = 0;
+
+  if (!tinylfu_door(f, hash))
+    changed = 1;
+  else
+  {
+    for (i = 0; i < TINYLFU_DEPTH; i++)
+    {
+      c = &f->counts[i * f->width + tinylfu_index(hash, i, mask)];
+      if ((v = __atomic_load_n(c, __ATOMIC_RELAXED)) < TINYLFU_MAX_COUNT)
+      {
+        __atomic_store_n(c, v + 1, __ATOMIC_RELAXED);
+        changed = 1;
+      }
+    }
+  }
+
+  if (!changed)
+    return 0;
+  return __atomic_add_fetch(&f->additions, 1, __ATOMIC_RELAXED) >= f->sample_size;
+}
+
+/**
+ * tinylfu_estimate 함수: 키의 접근 빈도를 추정합니다.
+ * 반환: 스케치의 최솟값에 doorkeeper에 있으면 1을 더한 값
+ */
+int tinylfu_estimate(tinylfu_t *f, uint64_t hash)
+{
+  size_t mask = f->width - 1, dmask = f->width * 8 - 1, bit;
+  int i, v, min = TINYLFU_MAX_COUNT, door = 1;
+
+  for (i = 0; i < TINYLFU_DEPTH; i++)
+  {
+    v = __atomic_load_n(&f->counts[i * f->width + tinylfu_index(hash, i, mask)], __ATOMIC_RELAXED);
+    if (v < min)
+      min = v;
+  }
+  for (i = 0; i < 2; i++)
+  {
+    bit = tinylfu_index(hash, TINYLFU_DEPTH + i, dmask);
+    if (!(__atomic_load_n(&f->door[bit >> 6], __ATOMIC_RELAXED) & (1ULL << (bit & 63))))
+      door = 0;
+  }
+  return min + door;
+}
+
+/**
+ * tinylfu_age 함수: 모든 카운터를 절반으로 줄이고 doorkeeper를 비웁니다.
+ * 동시에 들어온 기록 몇 개가 사라질 수 있지만 추정기의 정확도에는 영향이 거의 없습니다.
+ */
+void tinylfu_age(tinylfu_t *f)
+{
+  size_t i;
+
+  for (i = 0; i < TINYLFU_DEPTH * f->width; i++)
+    __atomic_store_n(&f->counts[i], __atomic_load_n(&f->counts[i], __ATOMIC_RELAXED) >> 1, __ATOMIC_RELAXED);
+  for (i = 0; i < f->width / 8; i++)
+    __atomic_store_n(&f->door[i], 0, __ATOMIC_RELAXED);
+  __atomic_store_n(&f->additions, 0, __ATOMIC_RELAXED);
+}
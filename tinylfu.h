@@ -0,0 +1,34 @@
+#ifndef __TINYLFU_H__
+#define __TINYLFU_H__
+
+#include <stdint.h>
+#include "csapp.h"
+
+#define TINYLFU_DEPTH 4       // count-min 스케치의 행 수
+#define TINYLFU_MAX_COUNT 15  // 카운터 상한 (4비트 카운터와 같은 의미)
+#define TINYLFU_MIN_WIDTH 1024
+
+/**
+ * tinylfu_t 구조체: TinyLFU 빈도 추정기입니다.
+ * counts: TINYLFU_DEPTH x width 크기의 count-min 스케치 (포화 카운터)
+ * door: 처음 본 키를 걸러 내는 doorkeeper 블룸 필터 (width * 8비트)
+ * width: 행 하나의 카운터 수 (2의 거듭제곱)
+ * additions: 마지막 노화 이후 스케치가 바뀐 횟수, sample_size: 노화 주기
+ */
+typedef struct tinylfu_t
+{
+  uint8_t *counts;
+  uint64_t *door;
+  size_t width;
+  unsigned additions;
+  unsigned sample_size;
+} tinylfu_t;
+
+// TinyLFU 함수 선언
+void tinylfu_init(tinylfu_t *f, size_t width);
+void tinylfu_deinit(tinylfu_t *f);
+int tinylfu_record(tinylfu_t *f, uint64_t hash);
+int tinylfu_estimate(tinylfu_t *f, uint64_t hash);
+void tinylfu_age(tinylfu_t *f);
+
+#endif /* __TINYLFU_H__ */
@@ -0,0 +1,208 @@
+#define _GNU_SOURCE
+#include "upstream.h"
+
+/*
+ * upstream.c - 원격 서버 keep-alive 연결 풀
+ *
+ * 캐시 미스마다 원격 서버에 새로 연결(TCP 핸드셰이크)하는 대신, 응답을 끝까지 받은 연결을
+ * (호스트, 포트)별로 쉬게 두었다가 다음 요청에 재사용합니다.
+ * 가장 최근에 쉰 연결부터 꺼내고 (LIFO), 꺼낼 때 원격 서버가 닫지 않았는지 확인합니다.
+ * UPSTREAM_IDLE_TIMEOUT보다 오래 쉰 연결과 한도를 넘는 연결은 닫습니다.
+ * 풀은 모든 모드가 함께 쓰며, 연결은 만든 모드의 방식(블로킹 여부)을 그대로 유지합니다.
+ */
+
+/**
+ * upstream_host_t 구조체: 원격 서버 하나의 쉬는 연결들입니다.
+ * fds, since, nidle: 쉬는 연결과 쉬기 시작한 시각 (뒤쪽이 최근), 그 수
+ */
+typedef struct upstream_host_t
+{
+  struct upstream_host_t *next;
+  uint64_t hash;
+  char *hostname, *port;
+  int fds[UPSTREAM_MAX_PER_HOST];
+  time_t since[UPSTREAM_MAX_PER_HOST];
+  int nidle;
+} upstream_host_t;
+
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static upstream_host_t *table[UPSTREAM_BUCKETS];
+static int total_idle;    // 풀 전체의 쉬는 연결 수
+static time_t last_sweep; // 마지막으로 오래 쉰 연결을 정리한 시각
+
+/**
+ * upstream_hash 함수: (호스트, 포트)의 FNV-1a 해시를 계산합니다.
+ */
+static uint64_t upstream_hash(char *hostname, char *port)
+{
+  uint64_t h = 14695981039346656037ULL;
+  char *s;
+
+  for (s = hostname; *s; s++)
+    h = (h ^ (unsigned char)*s) * 1099511628211ULL;
+  h = (h ^ ':') * 1099511628211ULL;
+  for (s = port; *s; s++)
+    h = (h ^ (unsigned char)*s) * 1099511628211ULL;
+  return h;
+}
+
+/**
+ * upstream_find 함수: 원격 서버의 항목을 찾습니다. pool_lock을 잡은 상태에서 불립니다.
+ * create: 없으면 새로 만듦
+ */
+static upstream_host_t *upstream_find(char *hostname, char *port, int create)
+{
+  uint64_t hash = upstream_hash(hostname, port);
+  upstream_host_t *h, **bucket = &table[hash & (UPSTREAM_BUCKETS - 1)];
+
+  for (h = *bucket; h; h = h->next)
+    if (h->hash == hash && !strcmp(h->hostname, hostname) && !strcmp(h->port, port))
+      return h;
+  if (!create)
+    return NULL;
+  h = Calloc(1, sizeof(upstream_host_t));
+  h->hash = hash;
+  h->hostname = strdup(hostname);
+  h->port = strdup(port);
+  h->next = *bucket;
+  *bucket = h;
+  return h;
+}
+
+/**
+ * upstream_sweep 함수: 오래 쉰 연결을 닫고, 쉬는 연결이 없는 원격 서버 항목을 해제합니다.
+ * pool_lock을 잡은 상태에서 초당 한 번까지 불립니다.
+ */
+static void upstream_sweep(time_t now)
+{
+  upstream_host_t *h, **pp;
+  int i, k;
+
+  last_sweep = now;
+  for (i = 0; i < UPSTREAM_BUCKETS; i++)
+  {
+    for (pp = &table[i]; (h = *pp) != NULL;)
+    {
+      // 앞쪽일수록 오래 쉰 연결
+      for (k = 0; k < h->nidle && now - h->since[k] > UPSTREAM_IDLE_TIMEOUT; k++)
+        close(h->fds[k]);
+      if (k > 0)
+      {
+        memmove(h->fds, h->fds + k, (h->nidle - k) * sizeof(int));
+        memmove(h->since, h->since + k, (h->nidle - k) * sizeof(time_t));
+        h->nidle -= k;
+        total_idle -= k;
+      }
+      if (h->nidle == 0)
+      {
+        *pp = h->next;
+        free(h->hostname);
+        free(h->port);
+        free(h);
+      }
+      else
+        pp = &h->next;
+    }
+  }
+}
+
+/**
+ * upstream_alive 함수: 쉬던 연결을 원격 서버가 닫지 않았는지 확인합니다.
+ * 쉬는 동안에는 원격 서버가 보낼 것이 없으므로 읽을 것이 있으면 (EOF 포함) 쓸 수 없는 연결입니다.
+ */
+static int upstream_alive(int fd)
+{
+  char ch;
+
+  return recv(fd, &ch, 1, MSG_PEEK | MSG_DONTWAIT) < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+}
+
+/**
+ * upstream_get 함수: 원격 서버에 쉬고 있는 연결을 하나 꺼냅니다.
+ * hostname, port: 요청 URI의 원격 서버
+ * 반환: 바로 요청을 보낼 수 있는 연결, 없으면 -1 (호출자가 새로 연결)
+ */
+int upstream_get(char *hostname, char *port)
+{
+  upstream_host_t *h;
+  time_t now = time(NULL);
+  int fd, expired;
+
+  while (1)
+  {
+    pthread_mutex_lock(&pool_lock);
+    if (!(h = upstream_find(hostname, port, 0)) || h->nidle == 0)
+    {
+      pthread_mutex_unlock(&pool_lock);
+      return -1;
+    }
+    fd = h->fds[--h->nidle];
+    total_idle--;
+    expired = now - h->since[h->nidle] > UPSTREAM_IDLE_TIMEOUT; // 그러면 앞쪽도 모두 오래되었음
+    pthread_mutex_unlock(&pool_lock);
+
+    if (!expired && upstream_alive(fd))
+      return fd;
+    close(fd); // 원격 서버가 닫았거나 너무 오래 쉰 연결
+    if (expired)
+      return -1;
+  }
+}
+
+/**
+ * upstream_put 함수: 응답을 끝까지 받은 연결을 다음 요청을 위해 쉬게 둡니다.
+ * 원격 서버나 풀 전체의 한도가 찼으면 연결을 닫습니다.
+ * fd: upstream_keepalive가 허락한 연결 (소유권이 풀로 넘어감)
+ */
+void upstream_put(int fd, char *hostname, char *port)
+{
+  upstream_host_t *h;
+  time_t now = time(NULL);
+
+  pthread_mutex_lock(&pool_lock);
+  if (now != last_sweep)
+    upstream_sweep(now);
+  h = upstream_find(hostname, port, 1);
+  if (h->nidle == UPSTREAM_MAX_PER_HOST || total_idle == UPSTREAM_MAX_IDLE)
+  {
+    pthread_mutex_unlock(&pool_lock);
+    close(fd);
+    return;
+  }
+  h->fds[h->nidle] = fd;
+  h->since[h->nidle++] = now;
+  total_idle++;
+  pthread_mutex_unlock(&pool_lock);
+}
+
+/**
+ * upstream_keepalive 함수: 응답을 받은 뒤 원격 서버가 연결을 유지하는지 확인합니다.
+ * HTTP/1.1 응답은 "Connection: close"가 없으면, HTTP/1.0 응답은 "Connection: keep-alive"가
+ * 있으면 유지합니다. 본문의 끝을 알 수 있는지는 호출자가 따로 확인해야 합니다.
+ * hdr: NUL 종료된 응답 상태 줄과 헤더
+ */
+int upstream_keepalive(char *hdr)
+{
+  char value[MAXLINE], *line, *eol;
+  int keep = !strncmp(hdr, "HTTP/1.1", strlen("HTTP/1.1"));
+  size_t len;
+
+  for (line = strstr(hdr, "\r\n"); line && line[2] != '\r'; line = eol)
+  {
+    line += 2;
+    if (!(eol = strstr(line, "\r\n")))
+      break;
+    if (strncasecmp(line, "Connection:", strlen("Connection:")))
+      continue;
+    len = eol - line - strlen("Connection:");
+    if (len >= sizeof(value))
+      continue;
+    memcpy(value, line + strlen("Connection:"), len);
+    value[len] = '\0';
+    if (strcasestr(value, "close"))
+      return 0;
+    if (strcasestr(value, "keep-alive"))
+      keep = 1;
+  }
+  return keep;
+}
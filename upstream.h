@@ -0,0 +1,17 @@
+#ifndef __UPSTREAM_H__
+#define __UPSTREAM_H__
+
+#include "csapp.h"
+
+// 원격 서버 연결 풀 상수 정의
+#define UPSTREAM_BUCKETS      64  // 원격 서버 표의 해시 버킷 수 (2의 거듭제곱)
+#define UPSTREAM_MAX_PER_HOST 8   // 원격 서버 (호스트, 포트) 하나에 남겨 둘 쉬는 연결 수
+#define UPSTREAM_MAX_IDLE     256 // 풀 전체에 남겨 둘 쉬는 연결 수
+#define UPSTREAM_IDLE_TIMEOUT 15  // 쉬는 연결을 닫기까지의 시간 (초, 원격 서버의 keep-alive 제한보다 짧게)
+
+// 원격 서버 연결 풀 함수 선언
+int upstream_get(char *hostname, char *port);
+void upstream_put(int fd, char *hostname, char *port);
+int upstream_keepalive(char *hdr);
+
+#endif /* __UPSTREAM_H__ */
@@ -0,0 +1,959 @@
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <sys/eventfd.h>
+#include <stdint.h>
+#include "proxy.h"
+
+/*
+ * uring.c - io_uring 기반 프록시 엔진
+ *
+ * Rio의 read/write 시스템 호출을 하나씩 부르는 대신, 루프마다 io_uring 하나에
+ * 작업을 모아 한 번의 io_uring_enter로 제출하고 완료를 받습니다.
+ *  - accept: multishot accept 하나가 계속 새 연결을 돌려줌
+ *  - 클라이언트/서버 읽기·쓰기: 미리 등록한 고정 버퍼(READ_FIXED/WRITE_FIXED)
+ *  - 원격 서버 연결: CONNECT와 요청 전송 WRITE를 IOSQE_IO_LINK로 묶어 함께 제출하고,
+ *    CONNECT에 LINK_TIMEOUT을 붙여 CONNECT_ATTEMPT_TIMEOUT 안에 연결되지 않으면 다음 주소 후보로 넘어감
+ * liburing 없이 커널 인터페이스(<linux/io_uring.h>)를 직접 사용합니다.
+ */
+
+#define UR_ENTRIES 1024             // 제출 큐 크기
+#define UR_NBUFS   256              // 루프마다 등록할 고정 버퍼 수
+#define UR_BUFSIZE UPSTREAM_BUFSIZE // 고정 버퍼 하나의 크기
+#define UR_OPMASK  0x7              // user_data 하위 비트에 담는 작업 종류 마스크
+
+/* 완료 이벤트의 작업 종류 (user_data 하위 3비트) */
+enum ur_op
+{
+  OP_ACCEPT,       // multishot accept (연결 포인터 없음)
+  OP_READ_CLIENT,  // 클라이언트 요청 읽기
+  OP_WRITE_CLIENT, // 클라이언트에 응답 쓰기
+  OP_CONNECT,      // 원격 서버 연결과 그 제한 시간 (OP_WRITE_SERVER와 연결됨)
+  OP_WRITE_SERVER, // 원격 서버에 요청 쓰기
+  OP_READ_SERVER,  // 원격 서버 응답 읽기
+  OP_FLIGHT_READ,  // 함께 기다리는 요청이나 주소 해석의 eventfd 읽기 (다음 공개나 해석 완료 대기)
+  OP_FLIGHT_WRITE  // 리더가 공개한 응답을 클라이언트에 쓰기
+};
+
+/* 주소 후보 하나의 연결 제한 시간 (LINK_TIMEOUT이 제출될 때 읽으므로 전역에 둠) */
+static struct __kernel_timespec connect_timeout = {
+    CONNECT_ATTEMPT_TIMEOUT / 1000, (CONNECT_ATTEMPT_TIMEOUT % 1000) * 1000000L};
+
+/**
+ * uring_t 구조체: 커널과 공유하는 제출/완료 큐의 매핑입니다.
+ * pending: 제출 큐에 올렸지만 아직 io_uring_enter로 알리지 않은 작업 수
+ */
+typedef struct uring_t
+{
+  int fd;
+  unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+  struct io_uring_sqe *sqes;
+  unsigned *cq_head, *cq_tail, *cq_mask;
+  struct io_uring_cqe *cqes;
+  unsigned sq_entries;
+  unsigned pending;
+} uring_t;
+
+/**
+ * uconn_t 구조체: io_uring 엔진이 관리하는 프록시 연결 하나의 상태입니다.
+ * 작업은 항상 한 번에 하나만(연결+요청 전송 쌍은 둘) 진행 중이므로 순차적인 상태만 둡니다.
+ * bufidx: 등록된 고정 버퍼 번호 (-1이면 일반 버퍼, RECV/SEND 사용)
+ * buf: 요청 읽기 → 원격 요청 → 응답 중계 순서로 재사용되는 UR_BUFSIZE 버퍼
+ * reply: 캐시 적중이나 오류 응답 (있으면 이 응답을 보낸 뒤 종료)
+ * path: 캐시 키 (GET이 아니면 NULL), reqflags: 요청 헤더 플래그
+ * stale: 재검증 중인 캐시 객체 (참조를 가진 상태, 응답 헤더를 다 받을 때까지 buf에 모아 둠)
+ * flight, leader: 함께 기다리는 원격 요청과 이 연결이 그 리더인지 (flight.c)
+ * efd, wakeups, fpos: 팔로워나 주소 해석을 기다리는 연결의 eventfd, 읽은 값, 팔로워가 클라이언트에 보낸 길이
+ * addrs, addr: 원격 서버 주소 후보와 연결을 시도할 후보의 인덱스
+ * resolving: 주소 해석을 기다리며 efd를 dns_lookup에 등록했으면 1
+ * host, port: 요청 URI의 원격 서버 (연결 풀의 키, 리더가 거절한 팔로워도 사용)
+ * req_len, reused: 원격 서버 요청의 길이, 원격 서버 연결을 풀에서 꺼냈으면 1
+ *                  (응답 없이 닫히면 buf에 남은 요청을 새 연결로 다시 보냄)
+ * server_done: 응답의 끝까지 받았으면 1 (연결을 유지하는 원격 서버는 닫지 않으므로)
+ * hdr_sent: 응답 헤더를 클라이언트에 보낼 형태로 바꿨으면 1 (그 전까지는 buf에 모아 둠, relay_header)
+ * inflight: 아직 완료되지 않은 작업 수, closing: 종료 중이면 1
+ */
+typedef struct uconn_t
+{
+  int clientfd, serverfd;
+  int bufidx;
+  char *buf;
+  size_t len, pos;
+  char *reply;
+  char *hdr;
+  dns_addrs_t addrs;
+  int addr;
+  int connect_failed;
+  char *path;
+  int reqflags;
+  web_object_t *stale;
+  flight_t *flight;
+  int leader;
+  int efd;
+  uint64_t wakeups;
+  size_t fpos;
+  int resolving;
+  char *host, *port;
+  size_t req_len;
+  int reused;
+  int server_done;
+  int hdr_sent;
+  resp_scan_t scan;
+  int inflight;
+  int closing;
+} uconn_t;
+
+/**
+ * urloop_t 구조체: io_uring 루프 스레드 하나의 상태입니다.
+ * bufs: 등록된 고정 버퍼 영역, free_bufs/nfree: 사용 가능한 버퍼 번호 스택
+ * multishot: multishot accept를 지원하면 1
+ */
+typedef struct urloop_t
+{
+  uring_t ring;
+  int listenfd;
+  cache_t *cache;
+  char *bufs;
+  int *free_bufs;
+  int nfree;
+  int multishot;
+} urloop_t;
+
+static void uc_request(urloop_t *loop, uconn_t *c);
+static void uc_fetch(urloop_t *loop, uconn_t *c, int pooled);
+
+/**
+ * uring_setup 함수: io_uring을 만들고 제출/완료 큐를 매핑합니다.
+ * 반환: 성공하면 0, io_uring을 사용할 수 없으면 -1
+ */
+static int uring_setup(uring_t *r, unsigned entries)
+{
+  struct io_uring_params p;
+  size_t sq_size, cq_size;
+  char *sq, *cq;
+  unsigned i;
+
+  memset(&p, 0, sizeof(p));
+  if ((r->fd = syscall(__NR_io_uring_setup, entries, &p)) < 0)
+    return -1;
+
+  sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  if (p.features & IORING_FEAT_SINGLE_MMAP)
+    sq_size = cq_size = sq_size > cq_size ? sq_size : cq_size;
+
+  sq = mmap(NULL, sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+  if (sq == MAP_FAILED)
+    return -1;
+  cq = sq;
+  if (!(p.features & IORING_FEAT_SINGLE_MMAP))
+  {
+    cq = mmap(NULL, cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+    if (cq == MAP_FAILED)
+      return -1;
+  }
+  r->sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+  if (r->sqes == MAP_FAILED)
+    return -1;
+
+  r->sq_head = (unsigned *)(sq + p.sq_off.head);
+  r->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+  r->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+  r->sq_array = (unsigned *)(sq + p.sq_off.array);
+  r->cq_head = (unsigned *)(cq + p.cq_off.head);
+  r->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+  r->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+  r->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+  r->sq_entries = p.sq_entries;
+  r->pending = 0;
+  for (i = 0; i < p.sq_entries; i++)
+    r->sq_array[i] = i;
+  return 0;
+}
+
+/**
+ * uring_enter 함수: 쌓인 작업을 제출하고, min_complete개 이상 완료될 때까지 기다립니다.
+ */
+static void uring_enter(uring_t *r, unsigned min_complete)
+{
+  int ret = syscall(__NR_io_uring_enter, r->fd, r->pending, min_complete,
+                    min_complete ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+  if (ret < 0)
+  {
+    if (errno != EINTR && errno != EAGAIN && errno != EBUSY)
+      unix_error("io_uring_enter error");
+    return;
+  }
+  r->pending -= ret;
+}
+
+/**
+ * uring_sqe 함수: 비어 있는 제출 큐 항목을 하나 얻습니다. 큐가 가득 차면 먼저 제출합니다.
+ * 반환된 항목은 0으로 초기화되어 있고 이미 제출 큐에 올라가 있습니다.
+ */
+static struct io_uring_sqe *uring_sqe(uring_t *r)
+{
+  unsigned tail = *r->sq_tail;
+  struct io_uring_sqe *sqe;
+
+  while (tail - __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE) >= r->sq_entries)
+    uring_enter(r, 0);
+
+  sqe = &r->sqes[tail & *r->sq_mask];
+  memset(sqe, 0, sizeof(*sqe));
+  __atomic_store_n(r->sq_tail, tail + 1, __ATOMIC_RELEASE);
+  r->pending++;
+  return sqe;
+}
+
+/**
+ * ur_prep 함수: 연결 c의 작업 하나를 제출 큐에 올립니다.
+ * 연결의 버퍼가 등록된 고정 버퍼이면 READ_FIXED/WRITE_FIXED를, 아니면 RECV/SEND를 사용합니다.
+ */
+static struct io_uring_sqe *ur_prep(urloop_t *loop, uconn_t *c, enum ur_op op, int fd, char *addr, size_t len)
+{
+  struct io_uring_sqe *sqe = uring_sqe(&loop->ring);
+  int is_read = (op == OP_READ_CLIENT || op == OP_READ_SERVER);
+  int fixed = c->bufidx >= 0 && addr >= c->buf && addr < c->buf + UR_BUFSIZE;
+
+  if (fixed)
+  {
+    sqe->opcode = is_read ? IORING_OP_READ_FIXED : IORING_OP_WRITE_FIXED;
+    sqe->buf_index = c->bufidx;
+  }
+  else
+  {
+    sqe->opcode = is_read ? IORING_OP_RECV : IORING_OP_SEND;
+    sqe->msg_flags = is_read ? 0 : MSG_NOSIGNAL;
+  }
+  sqe->fd = fd;
+  sqe->addr = (uintptr_t)addr;
+  sqe->len = len;
+  sqe->user_data = (uintptr_t)c | op;
+  c->inflight++;
+  return sqe;
+}
+
+/**
+ * ur_accept 함수: 리스닝 소켓에 (가능하면 multishot) accept를 제출합니다.
+ */
+static void ur_accept(urloop_t *loop)
+{
+  struct io_uring_sqe *sqe = uring_sqe(&loop->ring);
+
+  sqe->opcode = IORING_OP_ACCEPT;
+  sqe->fd = loop->listenfd;
+  sqe->accept_flags = SOCK_CLOEXEC;
+  if (loop->multishot)
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+  sqe->user_data = OP_ACCEPT;
+}
+
+/**
+ * uc_leave_flight 함수: 함께 기다리던 원격 요청에서 빠집니다. 리더면 요청을 끝냅니다.
+ * 리더가 더 이상 깨우지 않도록 eventfd를 등록에서 뺀 뒤에 닫습니다.
+ */
+static void uc_leave_flight(uconn_t *c)
+{
+  if (!c->flight)
+    return;
+  if (c->leader)
+    flight_end(c->flight);
+  flight_leave(c->flight, c->efd);
+  if (c->efd >= 0)
+    close(c->efd);
+  c->flight = NULL;
+  c->leader = 0;
+  c->efd = -1;
+}
+
+/**
+ * uc_leave_dns 함수: 기다리던 주소 해석에서 빠집니다.
+ * 해석 스레드가 더 이상 깨우지 않도록 eventfd를 등록에서 뺀 뒤에 닫습니다.
+ */
+static void uc_leave_dns(uconn_t *c)
+{
+  if (!c->resolving)
+    return;
+  dns_unwatch(origin_host(c->host), c->port, c->efd);
+  close(c->efd);
+  c->efd = -1;
+  c->resolving = 0;
+}
+
+/**
+ * uc_free 함수: 종료된 연결의 자원을 해제하고 고정 버퍼를 반납합니다.
+ */
+static void uc_free(urloop_t *loop, uconn_t *c)
+{
+  uc_leave_dns(c);
+  uc_leave_flight(c);
+  if (c->bufidx >= 0)
+    loop->free_bufs[loop->nfree++] = c->bufidx;
+  else
+    free(c->buf);
+  free(c->reply);
+  free(c->hdr);
+  free(c->path);
+  free(c->host);
+  free(c->port);
+  scan_free(&c->scan);
+  if (c->stale)
+    release_cache(c->stale);
+  free(c);
+}
+
+/**
+ * uc_release_server 함수: 원격 서버 연결을 응답의 끝까지 정확히 읽었고 원격 서버가 유지하면
+ * 풀에 돌려주고, 아니면 닫습니다.
+ */
+static void uc_release_server(uconn_t *c)
+{
+  resp_scan_t *sc = &c->scan;
+
+  if (c->serverfd < 0)
+    return;
+  if (c->server_done && sc->body_seen == sc->content_length && sc->hdr_len < sc->hdr_cap - 1 &&
+      upstream_keepalive(sc->hdr))
+    upstream_put(c->serverfd, c->host, c->port);
+  else
+    close(c->serverfd);
+  c->serverfd = -1;
+}
+
+/**
+ * uc_close 함수: 연결의 소켓을 닫습니다. 진행 중인 작업이 남아 있으면 shutdown으로
+ * (eventfd 읽기는 직접 깨워서) 완료시키고, 마지막 완료 이벤트를 받을 때 해제합니다.
+ * 응답을 끝까지 받은 원격 서버 연결에는 진행 중인 작업이 없으므로 풀에 돌려줄 수 있게 둡니다.
+ */
+static void uc_close(urloop_t *loop, uconn_t *c)
+{
+  uint64_t one = 1;
+
+  c->closing = 1;
+  if (c->inflight > 0)
+  {
+    if (c->efd >= 0 && write(c->efd, &one, sizeof(one)) < 0)
+      unix_error("eventfd write error");
+    shutdown(c->clientfd, SHUT_RDWR);
+    if (c->serverfd >= 0 && !c->server_done)
+      shutdown(c->serverfd, SHUT_RDWR);
+    return;
+  }
+  close(c->clientfd);
+  uc_release_server(c);
+  uc_free(loop, c);
+}
+
+/**
+ * uc_reply 함수: Malloc으로 할당된 응답을 클라이언트에 보내고 종료하도록 합니다.
+ */
+static void uc_reply(urloop_t *loop, uconn_t *c, char *data, size_t n)
+{
+  c->reply = data;
+  c->len = n;
+  c->pos = 0;
+  ur_prep(loop, c, OP_WRITE_CLIENT, c->clientfd, c->reply, c->len);
+}
+
+/**
+ * uc_error 함수: 클라이언트에게 HTTP 오류 응답을 보내고 종료하도록 합니다.
+ */
+static void uc_error(urloop_t *loop, uconn_t *c, char *cause, char *errnum, char *shortmsg, char *longmsg)
+{
+  char *buf = Malloc(MAXLINE + MAXBUF);
+  int n = format_clienterror(buf, cause, errnum, shortmsg, longmsg);
+  uc_reply(loop, c, buf, n);
+}
+
+/**
+ * uc_serve_stale 함수: 원격 서버 대신 신선하지 않은 캐시 객체로 응답합니다 (stale-if-error).
+ */
+static void uc_serve_stale(urloop_t *loop, uconn_t *c)
+{
+  size_t len;
+  char *out = dup_cache_response(c->stale, &len, 0);
+
+  release_cache(c->stale);
+  c->stale = NULL;
+  if (out)
+    uc_reply(loop, c, out, len);
+  else
+    uc_error(loop, c, "", "502", "Bad Gateway", "📍 Failed to read the cached object");
+}
+
+/**
+ * uc_bad_gateway 함수: 원격 서버에 연결할 수 없을 때, 보내도 되는 캐시 객체가 있으면
+ * 그것으로, 없으면 502로 응답합니다.
+ */
+static void uc_bad_gateway(urloop_t *loop, uconn_t *c, char *cause)
+{
+  if (c->stale && http_serve_stale(c->stale, c->reqflags, 1))
+    uc_serve_stale(loop, c);
+  else
+    uc_error(loop, c, cause, "502", "Bad Gateway", "📍 Failed to establish connection with the end server");
+}
+
+/**
+ * uc_start 함수: 새로 수락한 연결의 상태를 만들고 요청 읽기를 제출합니다.
+ */
+static void uc_start(urloop_t *loop, int clientfd)
+{
+  uconn_t *c = Calloc(1, sizeof(uconn_t));
+
+  c->clientfd = clientfd;
+  c->serverfd = -1;
+  c->efd = -1;
+  if (loop->nfree > 0)
+  {
+    c->bufidx = loop->free_bufs[--loop->nfree];
+    c->buf = loop->bufs + (size_t)c->bufidx * UR_BUFSIZE;
+  }
+  else
+  {
+    c->bufidx = -1;
+    c->buf = Malloc(UR_BUFSIZE);
+  }
+  ur_prep(loop, c, OP_READ_CLIENT, clientfd, c->buf, REQ_BUFSIZE - 1);
+}
+
+/**
+ * uc_connect 함수: 남은 주소 후보로 소켓을 만들고, 연결과 요청 전송을 링크로 묶어 제출합니다.
+ * 모든 후보가 실패하면 uc_bad_gateway로 응답합니다.
+ */
+static void uc_connect(urloop_t *loop, uconn_t *c)
+{
+  struct io_uring_sqe *sqe;
+
+  for (; c->addr < c->addrs.n; c->addr++)
+    if ((c->serverfd = socket(c->addrs.addr[c->addr].u.sa.sa_family, SOCK_STREAM | SOCK_CLOEXEC, 0)) >= 0)
+      break;
+  if (c->addr == c->addrs.n)
+  {
+    uc_bad_gateway(loop, c, "");
+    return;
+  }
+
+  c->connect_failed = 0;
+  sqe = uring_sqe(&loop->ring);
+  sqe->opcode = IORING_OP_CONNECT;
+  sqe->fd = c->serverfd;
+  sqe->addr = (uintptr_t)&c->addrs.addr[c->addr].u.sa;
+  sqe->off = c->addrs.addr[c->addr].len;
+  sqe->flags = IOSQE_IO_LINK;
+  sqe->user_data = (uintptr_t)c | OP_CONNECT;
+  c->inflight++;
+
+  // 기한이 지나면 CONNECT가 -ECANCELED로 취소되고, 링크된 요청 전송도 -ECANCELED로 완료됨
+  sqe = uring_sqe(&loop->ring);
+  sqe->opcode = IORING_OP_LINK_TIMEOUT;
+  sqe->fd = -1;
+  sqe->addr = (uintptr_t)&connect_timeout;
+  sqe->len = 1;
+  sqe->flags = IOSQE_IO_LINK;
+  sqe->user_data = (uintptr_t)c | OP_CONNECT;
+  c->inflight++;
+  ur_prep(loop, c, OP_WRITE_SERVER, c->serverfd, c->buf, c->len);
+}
+
+/**
+ * uc_wait_efd 함수: eventfd 읽기를 제출하여 다음 깨우기를 기다립니다 (eventfd는 블로킹이므로
+ * 값이 쓰일 때 완료됨).
+ */
+static void uc_wait_efd(urloop_t *loop, uconn_t *c)
+{
+  struct io_uring_sqe *sqe = uring_sqe(&loop->ring);
+
+  sqe->opcode = IORING_OP_READ;
+  sqe->fd = c->efd;
+  sqe->addr = (uintptr_t)&c->wakeups;
+  sqe->len = sizeof(c->wakeups);
+  sqe->user_data = (uintptr_t)c | OP_FLIGHT_READ;
+  c->inflight++;
+}
+
+/**
+ * uc_resolve 함수: 원격 서버 주소를 캐시에서 얻어 연결을 시작합니다 (dns.c).
+ * 캐시에 없으면 eventfd를 dns_lookup에 등록하고 그 읽기가 완료될 때 다시 불립니다.
+ * 해석할 수 없는 이름이면 uc_bad_gateway로 응답합니다.
+ */
+static void uc_resolve(urloop_t *loop, uconn_t *c)
+{
+  enum dns_status status;
+
+  while ((status = dns_lookup(origin_host(c->host), c->port, &c->addrs, c->efd)) == DNS_PENDING)
+  {
+    if (c->resolving)
+    {
+      uc_wait_efd(loop, c);
+      return;
+    }
+    if ((c->efd = eventfd(0, EFD_CLOEXEC)) < 0)
+      break;
+    c->resolving = 1; // 등록한 뒤 다시 조회 (그 사이 해석이 끝났을 수 있음)
+  }
+  uc_leave_dns(c);
+  if (status != DNS_OK)
+  {
+    uc_bad_gateway(loop, c, c->host);
+    return;
+  }
+  c->addr = 0;
+  uc_connect(loop, c);
+}
+
+/**
+ * uc_follow 함수: 리더가 공개한 응답 중 아직 보내지 않은 부분을 클라이언트에 쓰거나,
+ * 다 보냈으면 eventfd 읽기로 다음 공개를 기다립니다. 리더가 거절하면 직접 원격 서버에 연결합니다.
+ */
+static void uc_follow(urloop_t *loop, uconn_t *c)
+{
+  size_t len, avail;
+  char *data;
+  enum flight_state state = flight_poll(c->flight, &len);
+
+  if ((avail = follow_data(c->flight, len, c->fpos, &data)) > 0)
+  {
+    ur_prep(loop, c, OP_FLIGHT_WRITE, c->clientfd, data, avail);
+    return;
+  }
+  if (state == FLIGHT_DECLINED)
+  {
+    uc_leave_flight(c);
+    uc_fetch(loop, c, 1);
+    return;
+  }
+  if (state != FLIGHT_PENDING && state != FLIGHT_STREAM)
+  {
+    uc_close(loop, c); // 완료 또는 실패
+    return;
+  }
+  uc_wait_efd(loop, c);
+}
+
+/**
+ * uc_request 함수: 모인 요청을 해석하여 신선한 캐시 적중이면 바로 응답하고,
+ * 아니면 원격 서버 요청(신선하지 않은 객체는 조건부 요청)을 고정 버퍼에 만들고 연결을 시작합니다.
+ * 같은 경로를 이미 받아 오는 연결이 있으면 원격 서버 대신 그 응답을 함께 받습니다
+ * (eventfd는 블로킹으로 만들어 읽기가 다음 공개까지 커널 안에서 기다리게 함).
+ */
+static void uc_request(urloop_t *loop, uconn_t *c)
+{
+  char method[MAXLINE], path[MAXLINE], hostname[MAXLINE], port[MAXLINE], cond[MAXLINE];
+  char *out = Malloc(UPSTREAM_BUFSIZE);
+  size_t len;
+
+  int n = build_request(c->buf, out, method, hostname, port, path, &c->reqflags);
+  if (n < 0)
+  {
+    free(out);
+    if (n == REQ_NOT_IMPL)
+      uc_error(loop, c, method, "501", "Not implemented", "Tiny does not implement this method");
+    else
+      uc_error(loop, c, "", "400", "Bad Request", "Tiny could not parse the request");
+    return;
+  }
+
+  // 캐시된 객체가 신선하거나 재검증 중에 보내도 되면 헤더와 본문의 사본을 응답으로 전송하고
+  // (재검증을 맡았으면 백그라운드에서 재검증), 아니면 조건부 요청으로 재검증
+  int get = !strcasecmp(method, "GET"); // HEAD 응답은 본문이 없으므로 캐시를 쓰지 않음
+  web_object_t *cached_object = get ? lookup_cache(loop->cache, path) : NULL;
+  if (cached_object)
+  {
+    int claim = 0;
+    if (http_fresh(cached_object, c->reqflags) ||
+        (http_serve_stale(cached_object, c->reqflags, 0) && (claim = http_claim_refresh(cached_object)) >= 0))
+    {
+      char *reply = dup_cache_response(cached_object, &len, 0);
+      if (reply)
+      {
+        if (claim)
+          refresh_async(loop->cache, cached_object, out, n, hostname, port, c->reqflags);
+        else
+          release_cache(cached_object);
+        free(out);
+        uc_reply(loop, c, reply, len);
+        return;
+      }
+      if (claim)
+        http_release_refresh(cached_object);
+      release_cache(cached_object); // 본문을 읽을 수 없으면 미스로 처리
+      cached_object = NULL;
+    }
+    if (cached_object)
+    {
+      http_conditional(cached_object, cond, sizeof(cond));
+      n = http_add_conditional(out, n, UPSTREAM_BUFSIZE, cond);
+      c->stale = cached_object;
+    }
+  }
+
+  memcpy(c->buf, out, n);
+  free(out);
+  c->len = c->req_len = n;
+  c->pos = 0;
+  c->path = get ? strdup(path) : NULL;
+  c->host = strdup(hostname);
+  c->port = strdup(port);
+
+  if (get && !c->stale)
+  {
+    c->flight = flight_join(loop->cache, path, &c->leader);
+    if (!c->leader)
+    {
+      if ((c->efd = eventfd(0, EFD_CLOEXEC)) >= 0)
+      {
+        flight_watch(c->flight, c->efd);
+        uc_follow(loop, c);
+        return;
+      }
+      uc_leave_flight(c);
+    }
+  }
+  uc_fetch(loop, c, 1);
+}
+
+/**
+ * uc_fetch 함수: 버퍼의 요청을 보낼 원격 서버 연결을 얻습니다. pooled이면 풀에 쉬는 연결로
+ * 바로 요청을 보내고, 없으면 원격 서버 주소를 얻어 연결을 시작합니다.
+ */
+static void uc_fetch(urloop_t *loop, uconn_t *c, int pooled)
+{
+  if (pooled && (c->serverfd = upstream_get(c->host, c->port)) >= 0)
+  {
+    c->reused = 1;
+    ur_prep(loop, c, OP_WRITE_SERVER, c->serverfd, c->buf, c->len);
+    return;
+  }
+  c->reused = 0;
+  uc_resolve(loop, c);
+}
+
+/**
+ * uc_retry 함수: 풀에서 꺼낸 연결을 원격 서버가 그 사이 닫아 응답을 하나도 받지 못했으면
+ * 같은 요청을 새 연결로 다시 보냅니다 (GET, HEAD는 다시 보내도 안전).
+ * 응답 바이트가 없었으므로 buf의 요청은 그대로 남아 있습니다.
+ */
+static void uc_retry(urloop_t *loop, uconn_t *c)
+{
+  close(c->serverfd);
+  c->serverfd = -1;
+  free(c->hdr);
+  c->hdr = NULL;
+  c->len = c->req_len;
+  c->pos = 0;
+  uc_fetch(loop, c, 0);
+}
+
+/**
+ * uc_finish 함수: 응답 중계가 끝난 연결의 온전한 본문을 캐시에 저장하고 연결을 종료합니다.
+ */
+static void uc_finish(urloop_t *loop, uconn_t *c)
+{
+  web_object_t *web_object = scan_object(&c->scan, c->path, c->reqflags);
+  if (web_object)
+    write_cache(loop->cache, web_object);
+  uc_close(loop, c);
+}
+
+/**
+ * uc_revalidated 함수: 재검증 요청에 304가 오면 캐시된 본문을 갱신된 헤더와 함께 응답하고,
+ * 갱신된 객체로 캐시의 객체를 바꿉니다.
+ */
+static void uc_revalidated(urloop_t *loop, uconn_t *c)
+{
+  int storable;
+  size_t len;
+  web_object_t *fresh = http_refresh(c->stale, c->scan.hdr, c->reqflags,
+                                     c->scan.request_time, c->scan.response_time, &storable);
+  char *out = dup_cache_response(fresh ? fresh : c->stale, &len, 0);
+
+  if (fresh && storable)
+    write_cache(loop->cache, fresh);
+  else if (fresh)
+    free_cache_object(fresh);
+  release_cache(c->stale);
+  c->stale = NULL;
+  if (out)
+    uc_reply(loop, c, out, len);
+  else
+    uc_error(loop, c, "", "502", "Bad Gateway", "📍 Failed to read the cached object");
+}
+
+/**
+ * uc_complete 함수: 연결 c의 작업 하나가 완료되었을 때 다음 작업을 제출합니다.
+ * op: 완료된 작업 종류, res: 커널이 돌려준 결과 (바이트 수 또는 -errno)
+ */
+static void uc_complete(urloop_t *loop, uconn_t *c, enum ur_op op, int res)
+{
+  c->inflight--;
+  if (c->closing)
+  {
+    if (c->inflight == 0)
+      uc_close(loop, c);
+    return;
+  }
+
+  switch (op)
+  {
+  case OP_READ_CLIENT:
+    if (res <= 0)
+      break;
+    c->len += res;
+    c->buf[c->len] = '\0';
+    if (strstr(c->buf, "\r\n\r\n"))
+      uc_request(loop, c);
+    else if (c->len == REQ_BUFSIZE - 1)
+      uc_error(loop, c, "", "400", "Bad Request", "Request header too long");
+    else
+      ur_prep(loop, c, OP_READ_CLIENT, c->clientfd, c->buf + c->len, REQ_BUFSIZE - 1 - c->len);
+    return;
+
+  case OP_CONNECT:
+    // 실패하면 링크된 요청 전송이 -ECANCELED로 완료되므로 그때 처리
+    // (제한 시간의 완료는 -ETIME 또는 연결이 먼저 끝났으면 -ECANCELED)
+    if (res < 0 && res != -ETIME && res != -ECANCELED)
+      c->connect_failed = 1;
+    return;
+
+  case OP_WRITE_SERVER:
+    if (res < 0 && c->reused)
+    {
+      uc_retry(loop, c); // 풀에서 꺼낸 연결이 이미 닫혀 있었음
+      return;
+    }
+    if (c->connect_failed || res == -ECANCELED)
+    {
+      // 이 주소로의 연결 실패, 다음 후보 시도
+      close(c->serverfd);
+      c->serverfd = -1;
+      c->addr++;
+      uc_connect(loop, c);
+      return;
+    }
+    if (res < 0)
+      break;
+    c->pos += res;
+    if (c->pos < c->len)
+    {
+      ur_prep(loop, c, OP_WRITE_SERVER, c->serverfd, c->buf + c->pos, c->len - c->pos);
+      return;
+    }
+    // 요청 전송 완료, 응답 중계 시작 (len은 buf에 모인 응답 바이트 수)
+    // 헤더를 모으는 동안에는 relay_header가 붙일 자리를 buf 끝에 남겨 둠
+    c->hdr = Malloc(MAXLINE);
+    scan_init(&c->scan, c->hdr, MAXLINE, !c->path);
+    c->len = 0;
+    ur_prep(loop, c, OP_READ_SERVER, c->serverfd, c->buf, UR_BUFSIZE - RELAY_HDR_ROOM);
+    return;
+
+  case OP_READ_SERVER:
+    if (res <= 0 && c->reused && c->scan.hdr_len == 0)
+    {
+      uc_retry(loop, c); // 풀에서 꺼낸 연결이 이미 닫혀 있었음
+      return;
+    }
+    if (res < 0)
+      break;
+    if (res == 0)
+    {
+      if (c->stale && c->len == 0 && http_serve_stale(c->stale, c->reqflags, 1))
+      {
+        uc_serve_stale(loop, c); // 원격 서버가 응답 없이 연결을 닫음
+        return;
+      }
+      if (c->stale)
+      {
+        release_cache(c->stale);
+        c->stale = NULL;
+      }
+      if (c->len > 0)
+      {
+        // 헤더를 다 받기 전에 끝난 응답은 모아 둔 그대로 전달
+        c->hdr_sent = 1;
+        c->pos = 0;
+        ur_prep(loop, c, OP_WRITE_CLIENT, c->clientfd, c->buf, c->len);
+        return;
+      }
+      uc_finish(loop, c); // 응답 끝
+      return;
+    }
+    scan_response(&c->scan, c->buf + c->len, res);
+    if (c->leader)
+      scan_share(&c->scan, c->flight, c->path, c->reqflags);
+    c->len += res;
+    c->server_done = scan_done(&c->scan);
+    if (c->stale)
+    {
+      if (c->scan.hdr_done && c->scan.status == 304 && c->scan.hdr_len < c->scan.hdr_cap - 1)
+      {
+        uc_revalidated(loop, c);
+        return;
+      }
+      if (c->scan.hdr_done && c->scan.status >= 500 && http_serve_stale(c->stale, c->reqflags, 1))
+      {
+        uc_serve_stale(loop, c); // 원격 서버 오류
+        return;
+      }
+      if (!c->scan.hdr_done && c->len < UR_BUFSIZE - RELAY_HDR_ROOM)
+      {
+        ur_prep(loop, c, OP_READ_SERVER, c->serverfd, c->buf + c->len, UR_BUFSIZE - RELAY_HDR_ROOM - c->len);
+        return;
+      }
+      release_cache(c->stale); // 새 응답이므로 그대로 중계
+      c->stale = NULL;
+    }
+    if (!c->hdr_sent)
+    {
+      if (!c->scan.hdr_done && c->len < UR_BUFSIZE - RELAY_HDR_ROOM)
+      {
+        ur_prep(loop, c, OP_READ_SERVER, c->serverfd, c->buf + c->len, UR_BUFSIZE - RELAY_HDR_ROOM - c->len);
+        return;
+      }
+      c->len = relay_header(&c->scan, c->buf, c->len, UR_BUFSIZE);
+      c->hdr_sent = 1;
+    }
+    c->pos = 0;
+    ur_prep(loop, c, OP_WRITE_CLIENT, c->clientfd, c->buf, c->len);
+    return;
+
+  case OP_WRITE_CLIENT:
+    if (res < 0)
+      break;
+    c->pos += res;
+    if (c->pos < c->len)
+      ur_prep(loop, c, OP_WRITE_CLIENT, c->clientfd, (c->reply ? c->reply : c->buf) + c->pos, c->len - c->pos);
+    else if (!c->reply && c->server_done)
+      uc_finish(loop, c);
+    else if (!c->reply)
+    {
+      c->len = 0;
+      ur_prep(loop, c, OP_READ_SERVER, c->serverfd, c->buf, UR_BUFSIZE);
+    }
+    else
+      break; // 캐시 적중/오류 응답 전송 완료
+    return;
+
+  case OP_FLIGHT_WRITE:
+    if (res < 0)
+      break;
+    c->fpos += res;
+    uc_follow(loop, c);
+    return;
+
+  case OP_FLIGHT_READ:
+    if (res < 0)
+      break;
+    if (c->resolving)
+      uc_resolve(loop, c);
+    else
+      uc_follow(loop, c);
+    return;
+
+  case OP_ACCEPT:
+    return;
+  }
+  uc_close(loop, c);
+}
+
+/**
+ * uring_loop 함수: io_uring 루프 스레드의 본체입니다. 쌓인 작업을 제출하면서
+ * 완료 이벤트를 기다리고, 완료된 작업마다 연결의 다음 작업을 제출합니다.
+ *
+ * vargp: 이 스레드의 urloop_t 포인터
+ */
+static void *uring_loop(void *vargp)
+{
+  urloop_t *loop = (urloop_t *)vargp;
+  uring_t *r = &loop->ring;
+
+  ur_accept(loop);
+  while (1)
+  {
+    uring_enter(r, 1);
+
+    unsigned head = *r->cq_head;
+    unsigned tail = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+    for (; head != tail; head++)
+    {
+      struct io_uring_cqe *cqe = &r->cqes[head & *r->cq_mask];
+      enum ur_op op = cqe->user_data & UR_OPMASK;
+      int res = cqe->res;
+
+      if (op == OP_ACCEPT)
+      {
+        if (res >= 0)
+          uc_start(loop, res);
+        else if (res == -EINVAL && loop->multishot)
+          loop->multishot = 0; // 커널이 multishot accept를 지원하지 않음
+        if (!(cqe->flags & IORING_CQE_F_MORE))
+          ur_accept(loop);
+      }
+      else
+        uc_complete(loop, (uconn_t *)(uintptr_t)(cqe->user_data & ~(uint64_t)UR_OPMASK), op, res);
+    }
+    __atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+  }
+  return NULL;
+}
+
+/**
+ * urloop_init 함수: 루프의 io_uring을 만들고 고정 버퍼를 등록합니다.
+ * 버퍼 등록이 실패하면(RLIMIT_MEMLOCK 등) 일반 버퍼로 동작합니다.
+ * 반환: 성공하면 0, io_uring을 사용할 수 없으면 -1
+ */
+static int urloop_init(urloop_t *loop, int listenfd)
+{
+  struct iovec iov[UR_NBUFS];
+  int i;
+
+  if (uring_setup(&loop->ring, UR_ENTRIES) < 0)
+    return -1;
+  loop->listenfd = listenfd;
+  loop->cache = &proxy_cache;
+  loop->multishot = 1;
+  loop->bufs = Mmap(NULL, (size_t)UR_NBUFS * UR_BUFSIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  loop->free_bufs = Malloc(UR_NBUFS * sizeof(int));
+  for (i = 0; i < UR_NBUFS; i++)
+  {
+    iov[i].iov_base = loop->bufs + (size_t)i * UR_BUFSIZE;
+    iov[i].iov_len = UR_BUFSIZE;
+  }
+  if (syscall(__NR_io_uring_register, loop->ring.fd, IORING_REGISTER_BUFFERS, iov, UR_NBUFS) == 0)
+  {
+    for (i = 0; i < UR_NBUFS; i++)
+      loop->free_bufs[i] = UR_NBUFS - 1 - i;
+    loop->nfree = UR_NBUFS;
+  }
+  else
+    fprintf(stderr, "io_uring buffer registration failed (%s), using unregistered buffers\n", strerror(errno));
+  return 0;
+}
+
+/**
+ * uring_main 함수: uring 모드의 진입점입니다. nloops개의 io_uring 루프를 실행하며,
+ * 호출한 스레드도 루프 하나를 맡습니다. io_uring을 사용할 수 없으면 -1을 반환하고,
+ * 그렇지 않으면 반환하지 않습니다.
+ *
+ * listenfd: 리스닝 소켓
+ * nloops: 루프 스레드 수
+ */
+int uring_main(int listenfd, int nloops)
+{
+  pthread_t tid;
+  int i;
+  urloop_t *loops = Calloc(nloops, sizeof(urloop_t));
+
+  for (i = 0; i < nloops; i++)
+    if (urloop_init(&loops[i], listenfd) < 0)
+    {
+      if (i == 0)
+        return -1;
+      unix_error("io_uring_setup error");
+    }
+  for (i = 1; i < nloops; i++)
+    Pthread_create(&tid, NULL, uring_loop, &loops[i]);
+  uring_loop(&loops[0]);
+  return 0;
+}